@@ -1,6 +1,24 @@
 #include "hlt/hlt.hpp"
+#include "hlt/assignment.hpp"
+#include "hlt/economy.hpp"
+#include "hlt/engagement.hpp"
+#include "hlt/fleet_planner.hpp"
+#include "hlt/influence_map.hpp"
+#include "hlt/motion_history.hpp"
 #include "hlt/navigation.hpp"
+#include "hlt/opening.hpp"
+#include "hlt/player_stats.hpp"
+#include "hlt/profiling.hpp"
+#include "hlt/threat_table.hpp"
 #include "hlt/ship_combat.hpp"
+#include "hlt/rollout_search.hpp"
+#include "hlt/simulator.hpp"
+#include "hlt/speculation.hpp"
+#include "hlt/strategy.hpp"
+#include "hlt/turn_clock.hpp"
+
+#include <chrono>
+#include <memory>
 
 int main() {
     hlt::Metadata metadata = hlt::initialize("bhaxbot v6 v14");
@@ -18,26 +36,104 @@ int main() {
             << "; planets: " << initial_map.planets.size();
     hlt::Log::log(initial_map_intelligence.str());
 
-    bool should_rush_at_the_start = false;
-    bool has_decided_to_rush_at_the_start = false;
-    hlt::PlayerId rush_target;
+    const auto pre_game_start = std::chrono::steady_clock::now();
+
+    hlt::ThreadPool thread_pool(hlt::ThreadPool::default_thread_count());
+
+    // the first frame is the same as the initial map, so decide on rushing now, alongside the warm up
+    hlt::opening::RushPlan rush_plan;
+    hlt::TaskGroup pre_game;
+    thread_pool.run(pre_game, [&] { rush_plan = hlt::opening::analyse_rush(initial_map, player_id, thread_pool); });
+    thread_pool.run(pre_game, [&] { hlt::opening::warm_up(initial_map, player_id); });
+    thread_pool.wait(pre_game);
+
+    hlt::Log::log("docking slots: " + std::to_string(hlt::docking::DockingSlots::get().slot_count()) +
+        "; flow fields: " + std::to_string(hlt::navigation::FlowFieldCache::get().fields_built));
+    bool should_rush_at_the_start = rush_plan.should_rush;
+    hlt::PlayerId rush_target = rush_plan.target;
 
     bool has_decided_to_abandon = false;
+    hlt::strategy::StrategicPlanner planner;
     int game_turn = 0;
 
+    // too big for the stack, allocated once up front
+    std::unique_ptr<hlt::simulation::GameState> simulated_state(new hlt::simulation::GameState());
+    bool has_simulated_state = false;
+
+    std::unique_ptr<hlt::planning::ParallelPlanner> parallel_planner;
+    if (hlt::constants::ENABLE_PARALLEL_PLANNING && thread_pool.size() > 1) {
+        parallel_planner.reset(new hlt::planning::ParallelPlanner(thread_pool));
+    }
+
+    std::unique_ptr<hlt::search::RolloutSearch> rollout_search;
+    if (hlt::constants::ENABLE_ROLLOUT_SEARCH) {
+        rollout_search.reset(new hlt::search::RolloutSearch(thread_pool));
+    }
+
+    std::unique_ptr<hlt::speculation::Speculation> speculation;
+    if (hlt::constants::ENABLE_SPECULATION) {
+        speculation.reset(new hlt::speculation::Speculation());
+    }
+
+    std::ostringstream pre_game_log;
+    pre_game_log << "pre-game took "
+                 << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pre_game_start).count()
+                 << "ms on " << thread_pool.size() << " threads; rush: "
+                 << (should_rush_at_the_start ? "player " + std::to_string(rush_target) : std::string("no"));
+    hlt::Log::log(pre_game_log.str());
+
     std::vector<hlt::Move> moves;
     for (;;) {
         moves.clear();
         hlt::Map map = hlt::in::get_map();
         game_turn++;
+        thread_pool.reset_stats();
+
+        if (hlt::constants::ENABLE_SIMULATOR_CHECK) {
+            // replay last frame into this one and see whether we agree with the engine
+            if (has_simulated_state) {
+                simulated_state->infer_moves(map);
+                simulated_state->step();
+
+                int compared = 0;
+                const int mismatches = simulated_state->count_mismatches(map, compared);
+                hlt::Log::log("simulator check: " + std::to_string(mismatches) + " of " +
+                    std::to_string(compared) + " ships mismatched");
+            }
+            simulated_state->load(map);
+            has_simulated_state = true;
+        }
+
+        hlt::stats::PlayerStatsTable& player_stats = hlt::stats::PlayerStatsTable::get();
+        player_stats.update(map);
+
+        hlt::motion::MotionHistory& motion_history = hlt::motion::MotionHistory::get();
+        motion_history.record(map);
+        if (hlt::constants::ENABLE_MOTION_PREDICTION) {
+            motion_history.apply_predictions(map, player_id);
+        }
+
+        hlt::economy::EconomyForecast& economy = hlt::economy::EconomyForecast::get();
+        economy.update(map, game_turn);
+
+        hlt::navigation::NavigationCache& navigation_cache = hlt::navigation::NavigationCache::get();
+        navigation_cache.begin_turn(map, player_id);
+        hlt::navigation::FlowFieldCache::get().begin_turn();
+        hlt::docking::DockingSlots::get().begin_turn(map, player_id);
+
+        // take over what was worked out while we waited for this frame
+        hlt::speculation::SpeculationReport speculation_report;
+        const bool has_influence = speculation && speculation->adopt(map, speculation_report);
+
+        hlt::combat::InfluenceMap& influence = hlt::combat::InfluenceMap::get();
+        if (!has_influence) {
+            influence.build(map, player_id);
+        }
+        hlt::combat::ThreatTable::get().build(map, player_id);
 
         // build a list of nearby enemys and targets
+        hlt::profiling::ScopedTimer nearby_timer(hlt::profiling::Phase::NearbyEntities);
         for (hlt::Ship &ship : map.ships.at(player_id)) {
-            if (ship.docking_status == hlt::ShipDockingStatus::Docking) {
-                auto planet = map.get_planet(ship.docked_planet);
-                map.add_moving_towards(planet, ship);
-            }
-
             if (ship.docking_status != hlt::ShipDockingStatus::Undocked) {     
                 continue;
             }
@@ -80,120 +176,185 @@ int main() {
                 }
             }
         }
-
-        // only run once at the start of the game
-        if (has_decided_to_rush_at_the_start == false) {
-            for (hlt::Ship& ship : map.ships.at(player_id)) {
-                // we want to check weather we can rush or not
-                ship.sort_nearby_entitys();
-                hlt::NearbyEntity entity = ship.nearby_enemy_ships[0];
-                hlt::Ship closest_enemy_ship = map.get_ship(entity.owner_id, entity.entity_id);
-
-                int time_to_build_new_ship = 9; // it takes 9 turns for a ship to be produced (if all 3 ships decide to dock)
-                int time_to_kill_enemy_ships = 0;
-                bool conditions_met = false;
-
-                auto distance_to_closest_planet = 99999;
-                hlt::Planet closest_planet;
-                for (hlt::Planet& planet : map.planets) {
-                    auto planet_to_enemy_distance = closest_enemy_ship.location.distance(planet.location);
-                    if (planet_to_enemy_distance < distance_to_closest_planet) {
-                        distance_to_closest_planet = planet_to_enemy_distance;
-                        closest_planet = planet;
+        nearby_timer.stop();
+
+        // strategic tier: fleet-level decisions, only redone every few turns or when something big happens
+        const auto strategy_start = std::chrono::steady_clock::now();
+        hlt::assignment::TargetAssignment& target_assignment = hlt::assignment::TargetAssignment::get();
+        const hlt::strategy::ReplanReason replan_reason = planner.should_replan(map, game_turn);
+        if (replan_reason != hlt::strategy::ReplanReason::None) {
+            // decide whether abandoning is the best option
+            if (!should_rush_at_the_start && !has_decided_to_abandon) {
+                const hlt::profiling::ScopedTimer abandon_timer(hlt::profiling::Phase::AbandonCheck);
+                if (initial_map.ship_map.size() > 2) {
+                    const int total_ships = player_stats.total().ships;
+                    const int my_total_ships = player_stats.of(player_id).ships;
+
+                    int MAX_OWNED_PERCENTAGE = 15.5;
+                    float owned_percentage = ((float)my_total_ships / (float)total_ships) * 100;
+                    if (owned_percentage < MAX_OWNED_PERCENTAGE) {
+                        has_decided_to_abandon = true;
                     }
                 }
-                
-                // calculate how long it takes to reach a location our enemy can dock at
-                const double max_dist_to_dock = hlt::constants::DOCK_RADIUS + closest_planet.radius - hlt::constants::SHIP_RADIUS;
-                hlt::Location closest_location = closest_enemy_ship.location.get_closest_point(closest_planet.location, max_dist_to_dock);
-                time_to_build_new_ship += closest_enemy_ship.location.distance(closest_location) / hlt::constants::MAX_SPEED;
-
-                const double ship_health = 255;
-                const double attack_damage = 192; // may need to lower to adjust to slower ships
-                time_to_kill_enemy_ships += closest_enemy_ship.location.distance(ship.location) / hlt::constants::MAX_SPEED;
-                time_to_kill_enemy_ships += (attack_damage / ship_health) * 1; // how long it takes to kill one ship
-                // by the time one ship is dead, the delay to make another will increase, making it take longer to make another ship
-
-                if (time_to_kill_enemy_ships < time_to_build_new_ship) {
-                    conditions_met = true;
-                }
-
-                if (conditions_met) {
-                    // at this distance they shouldn't be able to make another ship before we kill them
-                    should_rush_at_the_start = true;
-                    rush_target = entity.owner_id;
-                    break;
-                }
             }
 
-            has_decided_to_rush_at_the_start = true;
+            target_assignment.solve(map, player_id);
+            planner.mark_planned(map, game_turn);
+        } else {
+            // keep the assignment in step with ships that died or spawned since
+            target_assignment.update_fleet(map, player_id);
         }
-
-        // decide whether abandoning is the best option
-        if (!should_rush_at_the_start && !has_decided_to_abandon) {
-            if (initial_map.ship_map.size() > 2) {
-                int total_ships = 0;
-                int my_total_ships = 0;
-
-                for (const auto& player_ship : map.ships) {
-                    for (const hlt::Ship& ship : player_ship.second) {
-                        if (player_ship.first == player_id) {
-                            my_total_ships++;
-                        }
-                        total_ships++;
-                    }
+        const double strategy_ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - strategy_start).count();
+
+        // tactical tier: move and fight for the current plan, every turn
+        const auto tactics_start = std::chrono::steady_clock::now();
+        std::unordered_set<hlt::EntityId> searched_ships;
+        if (rollout_search && !has_decided_to_abandon && !should_rush_at_the_start) {
+            const std::vector<hlt::search::ShipGroup> groups = hlt::search::group_ships(map, player_id);
+            if (!groups.empty()) {
+                hlt::search::SearchReport report;
+                // leave at least half of what's left of the turn for everyone else
+                const double budget_ms = std::min(hlt::constants::SEARCH_TURN_BUDGET_MS,
+                    hlt::timing::TurnClock::get().remaining_ms() / 2);
+                const hlt::possibly<int> plan = rollout_search->search(map, player_id, groups, budget_ms, report);
+                if (plan.second) {
+                    searched_ships = hlt::search::commit(map, player_id, groups, plan.first, moves);
                 }
 
-                int MAX_OWNED_PERCENTAGE = 15.5;
-                float owned_percentage = ((float)my_total_ships / (float)total_ships) * 100;
-                if (owned_percentage < MAX_OWNED_PERCENTAGE) {
-                    has_decided_to_abandon = true;
-                }
+                std::ostringstream search_log;
+                search_log << "rollout search: " << groups.size() << " groups, " << report.candidates << " candidates; "
+                           << report.rollouts << " rollouts in " << report.elapsed_ms << "ms ("
+                           << report.rollouts_per_second() << "/s) on " << thread_pool.size() << " threads; depth "
+                           << report.depth << "; best score " << report.best_score
+                           << (plan.second ? "" : "; no pass finished, planning the groups as usual");
+                hlt::Log::log(search_log.str());
             }
         }
 
         // now once we have our nearby entitys
         // we want to utilize them in some shape or form
-        for (hlt::Ship &ship : map.ships.at(player_id)) {
-            bool has_made_move = false;
-
-            if (!has_made_move && has_decided_to_abandon) {
-                hlt::combat::handle_abandonment(map, moves, ship, 360);
-                has_made_move = true;
-            }
-
-            if (ship.priority_targets.empty()) {
-                // ship has no targets, its probably docked or everyone could be dead
-                continue;
-            }
-
-            if (!has_made_move && should_rush_at_the_start) {
-                hlt::combat::handle_rush(map, moves, rush_target, should_rush_at_the_start, ship);
-                has_made_move = true;
+        hlt::planning::TurnContext planning_context = {
+            player_id, has_decided_to_abandon, should_rush_at_the_start, rush_target, &searched_ships, false };
+        hlt::planning::PlanningReport planning_report;
+        hlt::profiling::ScopedTimer planning_timer(hlt::profiling::Phase::Planning);
+        if (parallel_planner) {
+            if (game_turn == hlt::constants::PLANNING_SPEEDUP_REPORT_TURN) {
+                parallel_planner->report_speedup(map, planning_context);
             }
 
-            while (!has_made_move && !ship.priority_targets.empty()) {
-                auto entity = ship.priority_targets.top();
-                ship.priority_targets.pop();
-
-                if (hlt::combat::handle_ship(map, player_id, moves, ship, entity)) {
-                    has_made_move = true;
-                    break;
+            parallel_planner->plan_fleet(map, planning_context, moves, planning_report);
+
+            std::ostringstream planning_log;
+            planning_log << "parallel planning: " << planning_report.ships << " ships, "
+                         << planning_report.accepted << " proposals kept, " << planning_report.replanned
+                         << " replanned; propose " << planning_report.propose_ms << "ms, merge "
+                         << planning_report.merge_ms << "ms on " << thread_pool.size() << " threads";
+            hlt::Log::log(planning_log.str());
+
+            const std::vector<hlt::planning::RegionLoad>& region_loads = parallel_planner->last_region_loads();
+            if (!region_loads.empty()) {
+                double slowest_ms = 0;
+                double total_ms = 0;
+                std::ostringstream region_log;
+                region_log << "regions: " << region_loads.size() << ";";
+                for (const hlt::planning::RegionLoad& load : region_loads) {
+                    region_log << " " << load.ships << " ships/" << load.local_ships << " local/"
+                               << load.deferred << " deferred " << load.ms << "ms;";
+                    slowest_ms = std::max(slowest_ms, load.ms);
+                    total_ms += load.ms;
                 }
+                region_log << " slowest region " << (total_ms > 0 ? slowest_ms * region_loads.size() / total_ms : 1)
+                           << "x the mean";
+                hlt::Log::log(region_log.str());
             }
+        } else {
+            hlt::planning::plan_fleet_serial(map, planning_context, moves, planning_report);
         }
+        should_rush_at_the_start = planning_context.should_rush_at_the_start;
+        planning_timer.stop();
+
+        hlt::navigation::resolve_local_avoidance(map, player_id, moves);
 
         // check for collisions
+        hlt::profiling::ScopedTimer collision_timer(hlt::profiling::Phase::CollisionCheck);
         for (hlt::Ship &ship : map.ships.at(player_id)) {
             hlt::Location temp_target = { 1, 1 };
             if (hlt::collision::will_collide(map, ship, temp_target)) {
                 hlt::Log::log("late collision found ship: " + std::to_string(ship.entity_id));
             }
         }
+        collision_timer.stop();
+
+        const double tactics_ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tactics_start).count();
+
+        std::ostringstream strategy_log;
+        if (replan_reason != hlt::strategy::ReplanReason::None) {
+            strategy_log << "strategy: replanned (" << hlt::strategy::to_string(replan_reason) << ") in " << strategy_ms << "ms";
+        } else {
+            strategy_log << "strategy: kept plan from turn " << planner.planned_turn();
+        }
+        strategy_log << "; tactics took " << tactics_ms << "ms";
+        hlt::Log::log(strategy_log.str());
+
+        const hlt::SchedulerStats scheduler = thread_pool.stats();
+        std::ostringstream scheduler_log;
+        scheduler_log << "scheduler: " << scheduler.tasks << " tasks on " << thread_pool.size() << " threads, "
+                      << scheduler.most_tasks << " on the busiest and " << scheduler.fewest_tasks << " on the quietest; "
+                      << scheduler.steals << " stolen, " << scheduler.failed_steals << " failed steals; idle "
+                      << scheduler.idle_ms << "ms";
+        hlt::Log::log(scheduler_log.str());
+
+        hlt::Log::log("navigation cache hits: " + std::to_string(navigation_cache.hits) +
+            "; misses: " + std::to_string(navigation_cache.misses) +
+            "; flow fields built: " + std::to_string(hlt::navigation::FlowFieldCache::get().fields_built));
+
+        std::ostringstream economy_log;
+        economy_log << "economy: " << economy.planets_extended << " planets extended, "
+                    << economy.planets_replayed << " replayed;";
+        for (const auto& player_ships : map.ships) {
+            economy_log << " player " << player_ships.first << " next spawn " << economy.next_spawn_turn(player_ships.first)
+                        << ", " << economy.fleet_size_in(player_ships.first, 20) << " ships in 20 turns;";
+        }
+        hlt::Log::log(economy_log.str());
+
+        if (replan_reason != hlt::strategy::ReplanReason::None) {
+            hlt::Log::log("target assignment: " + std::to_string(target_assignment.assigned_count()) + " of " +
+                std::to_string(target_assignment.ship_count()) + " ships; " + std::to_string(target_assignment.kept) +
+                " kept from last turn; " + std::to_string(target_assignment.bids) + " bids in " +
+                std::to_string((int) target_assignment.solve_us) + "us");
+        } else {
+            hlt::Log::log("target assignment: " + std::to_string(target_assignment.assigned_count()) + " of " +
+                std::to_string(target_assignment.ship_count()) + " ships; " + std::to_string(target_assignment.freed) +
+                " freed, " + std::to_string(target_assignment.joined) + " joined in " +
+                std::to_string((int) target_assignment.solve_us) + "us");
+        }
+
+        if (speculation_report.had_prediction) {
+            std::ostringstream speculation_log;
+            speculation_log << "speculation: influence kept for " << speculation_report.kept << " ships, "
+                            << speculation_report.moved << " moved, " << speculation_report.added << " added, "
+                            << speculation_report.removed << " removed; " << speculation_report.fields_adopted
+                            << " flow fields adopted; background took " << speculation_report.background_ms << "ms";
+            hlt::Log::log(speculation_log.str());
+        }
+
+        const hlt::timing::TurnClock& turn_clock = hlt::timing::TurnClock::get();
+        std::ostringstream turn_clock_log;
+        turn_clock_log << "turn clock: " << planning_report.full << " ships planned in full, "
+                       << planning_report.degraded << " cut short, " << planning_report.fallback
+                       << " on fallback moves; sending after " << turn_clock.elapsed_ms() << "ms, effort "
+                       << turn_clock.effort();
+        hlt::Log::log(turn_clock_log.str());
 
         if (!hlt::out::send_moves(moves)) {
             hlt::Log::log("send_moves failed; exiting");
             break;
         }
+
+        if (speculation) {
+            speculation->begin(map, player_id);
+        }
     }
 }
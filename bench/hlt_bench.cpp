@@ -0,0 +1,465 @@
+#include "hlt/hlt.hpp"
+#include "hlt/collision.hpp"
+#include "hlt/influence_map.hpp"
+#include "hlt/navigation.hpp"
+#include "hlt/ship_combat.hpp"
+#include "hlt/turn_clock.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Microbenchmarks for the geometry, collision, navigation and parsing code
+// under hlt/. Each case runs at a few entity counts and prints one tab
+// separated line per count:
+//
+//     case  entities  iterations  ns_per_op  min_ns_per_op
+//
+// ns_per_op is the median over BENCH_REPETITIONS timed batches. Save the
+// output of two builds and run `hlt_bench compare before.tsv after.tsv` to
+// see what changed. A first argument other than compare only runs the cases
+// whose name contains it.
+
+namespace bench {
+    using namespace hlt;
+
+    /** Wall clock each timed batch of a case aims for */
+    constexpr double BENCH_BATCH_MS = 20.0;
+
+    /** Timed batches per case and entity count */
+    constexpr int BENCH_REPETITIONS = 7;
+
+    /** Same seed for every build, so both sides of a comparison see the same scenes */
+    constexpr unsigned int BENCH_SEED = 20171121;
+
+    constexpr int MAP_WIDTH = 384;
+    constexpr int MAP_HEIGHT = 256;
+    constexpr int PLAYERS = 4;
+
+    /// Keeps the compiler from dropping work whose result is never used.
+    static volatile double sink = 0;
+
+    struct Result {
+        std::string name;
+        unsigned int entities;
+        unsigned long long iterations;
+        double ns_per_op;
+        double min_ns_per_op;
+    };
+
+    /// One operation on a scene built beforehand; returns anything derived from its work.
+    typedef std::function<double()> Operation;
+
+    struct Case {
+        std::string name;
+        std::vector<unsigned int> entity_counts;
+        std::function<Operation(unsigned int)> setup;
+    };
+
+    static double run_batch(const Operation& operation, const unsigned long long iterations) {
+        typedef std::chrono::steady_clock clock;
+        // navigation and the safe-location search cut their effort as the turn clock runs down
+        timing::TurnClock::get().start();
+
+        double result = 0;
+        const clock::time_point start = clock::now();
+        for (unsigned long long i = 0; i < iterations; ++i) {
+            result += operation();
+        }
+        const double elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        sink = sink + result;
+        return elapsed_ns;
+    }
+
+    static Result measure(const std::string& name, const unsigned int entities, const Operation& operation) {
+        // double the batch until it is long enough to time, then size it to BENCH_BATCH_MS
+        unsigned long long iterations = 1;
+        double elapsed_ns = run_batch(operation, iterations);
+        while (elapsed_ns < 1e6 && iterations < (1ULL << 40)) {
+            iterations *= 2;
+            elapsed_ns = run_batch(operation, iterations);
+        }
+        iterations = std::max(1ULL, (unsigned long long) (iterations * BENCH_BATCH_MS * 1e6 / elapsed_ns));
+
+        std::vector<double> per_op;
+        for (int i = 0; i < BENCH_REPETITIONS; ++i) {
+            per_op.push_back(run_batch(operation, iterations) / iterations);
+        }
+        std::sort(per_op.begin(), per_op.end());
+
+        return { name, entities, iterations, per_op[per_op.size() / 2], per_op.front() };
+    }
+
+    static Ship make_ship(const EntityId ship_id, const PlayerId owner_id, const Location& location) {
+        Ship ship;
+        ship.entity_id = ship_id;
+        ship.owner_id = owner_id;
+        ship.location = location;
+        ship.health = constants::BASE_SHIP_HEALTH;
+        ship.radius = constants::SHIP_RADIUS;
+        ship.weapon_cooldown = 0;
+        ship.docking_status = ShipDockingStatus::Undocked;
+        ship.docking_progress = 0;
+        ship.docked_planet = 0;
+        return ship;
+    }
+
+    static void add_ship(Map& map, const Ship& ship) {
+        map.ship_map[ship.owner_id][ship.entity_id] = map.ships[ship.owner_id].size();
+        map.ships[ship.owner_id].push_back(ship);
+    }
+
+    static void add_planet(Map& map, const EntityId planet_id, const Location& location, const double radius) {
+        Planet planet;
+        planet.entity_id = planet_id;
+        planet.owner_id = -1;
+        planet.location = location;
+        planet.health = 1000;
+        planet.radius = radius;
+        planet.is_owned = false;
+        planet.docking_spots = 3;
+        planet.current_production = 0;
+        planet.remaining_production = 1000;
+
+        map.planet_map[planet_id] = map.planets.size();
+        map.planets.push_back(planet);
+    }
+
+    static Location random_location(std::mt19937& random, const double min_x, const double min_y,
+                                    const double max_x, const double max_y) {
+        std::uniform_real_distribution<double> x(min_x, max_x);
+        std::uniform_real_distribution<double> y(min_y, max_y);
+        const double pos_x = x(random);
+        return { pos_x, y(random) };
+    }
+
+    /// ship_count ships shared out between PLAYERS players anywhere on the map, and planet_count planets.
+    static Map random_map(const unsigned int ship_count, const unsigned int planet_count, std::mt19937& random) {
+        Map map(MAP_WIDTH, MAP_HEIGHT);
+        for (PlayerId player_id = 0; player_id < PLAYERS; ++player_id) {
+            map.ships[player_id];
+            map.ship_map[player_id];
+        }
+
+        std::uniform_real_distribution<double> radius(3, 8);
+        for (unsigned int i = 0; i < planet_count; ++i) {
+            add_planet(map, i, random_location(random, 10, 10, MAP_WIDTH - 10, MAP_HEIGHT - 10), radius(random));
+        }
+        for (unsigned int i = 0; i < ship_count; ++i) {
+            add_ship(map, make_ship(i, i % PLAYERS, random_location(random, 1, 1, MAP_WIDTH - 1, MAP_HEIGHT - 1)));
+        }
+        return map;
+    }
+
+    /**
+     * Player 0's ship 0 in the middle of the map with a planet between it
+     * and crowd_target(), and crowd ships of crowd_owner scattered around it.
+     */
+    static Map crowded_map(const unsigned int crowd, const PlayerId crowd_owner, std::mt19937& random) {
+        Map map(MAP_WIDTH, MAP_HEIGHT);
+        for (PlayerId player_id = 0; player_id < PLAYERS; ++player_id) {
+            map.ships[player_id];
+            map.ship_map[player_id];
+        }
+
+        const Location center = { MAP_WIDTH / 2.0, MAP_HEIGHT / 2.0 };
+        add_planet(map, 0, { center.pos_x + 20, center.pos_y }, 8);
+        add_planet(map, 1, { center.pos_x - 40, center.pos_y + 30 }, 6);
+        add_ship(map, make_ship(0, 0, center));
+
+        for (unsigned int i = 1; i <= crowd; ++i) {
+            Location location;
+            do {
+                location = random_location(random, center.pos_x - 20, center.pos_y - 20, center.pos_x + 20, center.pos_y + 20);
+            } while (location.get_distance_to(center) < 2 || location.get_distance_to(map.planets[0].location) < 9);
+            add_ship(map, make_ship(i, crowd_owner, location));
+        }
+        return map;
+    }
+
+    static Location crowd_target() {
+        return { MAP_WIDTH / 2.0 + 50, MAP_HEIGHT / 2.0 };
+    }
+
+    /// map as the engine would send it.
+    static std::string to_frame(const Map& map) {
+        std::ostringstream frame;
+        frame << map.ships.size();
+        for (PlayerId player_id = 0; player_id < (PlayerId) map.ships.size(); ++player_id) {
+            const std::vector<Ship>& ships = map.ships.at(player_id);
+            frame << " " << player_id << " " << ships.size();
+            for (const Ship& ship : ships) {
+                frame << " " << ship.entity_id << " " << ship.location.pos_x << " " << ship.location.pos_y << " "
+                      << ship.health << " 0 0 " << static_cast<int>(ship.docking_status) << " " << ship.docked_planet
+                      << " " << ship.docking_progress << " " << ship.weapon_cooldown;
+            }
+        }
+        frame << " " << map.planets.size();
+        for (const Planet& planet : map.planets) {
+            frame << " " << planet.entity_id << " " << planet.location.pos_x << " " << planet.location.pos_y << " "
+                  << planet.health << " " << planet.radius << " " << planet.docking_spots << " "
+                  << planet.current_production << " " << planet.remaining_production << " 0 0 0";
+        }
+        return frame.str();
+    }
+
+    /// Swallows whatever send_moves writes.
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(const int c) override {
+            return c;
+        }
+
+        std::streamsize xsputn(const char*, const std::streamsize count) override {
+            return count;
+        }
+    };
+
+    static std::vector<Case> cases() {
+        std::vector<Case> all;
+
+        all.push_back({ "parse_map", { 40, 400, 4000 }, [](const unsigned int ships) -> Operation {
+            std::mt19937 random(BENCH_SEED);
+            const std::string frame = to_frame(random_map(ships, 28, random));
+            return [frame] {
+                return (double) in::parse_map(frame, MAP_WIDTH, MAP_HEIGHT).planets.size();
+            };
+        } });
+
+        all.push_back({ "location_distance", { 64, 1024, 16384 }, [](const unsigned int points) -> Operation {
+            std::mt19937 random(BENCH_SEED);
+            std::shared_ptr<std::vector<Location>> locations = std::make_shared<std::vector<Location>>();
+            for (unsigned int i = 0; i < points; ++i) {
+                locations->push_back(random_location(random, 0, 0, MAP_WIDTH, MAP_HEIGHT));
+            }
+            return [locations] {
+                const Location from = { MAP_WIDTH / 2.0, MAP_HEIGHT / 2.0 };
+                double total = 0;
+                for (const Location& location : *locations) {
+                    total += from.get_distance_to(location);
+                }
+                return total;
+            };
+        } });
+
+        all.push_back({ "location_orient", { 64, 1024, 16384 }, [](const unsigned int points) -> Operation {
+            std::mt19937 random(BENCH_SEED);
+            std::shared_ptr<std::vector<Location>> locations = std::make_shared<std::vector<Location>>();
+            for (unsigned int i = 0; i < points; ++i) {
+                locations->push_back(random_location(random, 0, 0, MAP_WIDTH, MAP_HEIGHT));
+            }
+            return [locations] {
+                const Location from = { MAP_WIDTH / 2.0, MAP_HEIGHT / 2.0 };
+                double total = 0;
+                for (const Location& location : *locations) {
+                    total += from.orient_towards_in_deg(location) + from.orient_towards_in_rad(location);
+                }
+                return total;
+            };
+        } });
+
+        all.push_back({ "segment_circle_intersect", { 16, 256, 4096 }, [](const unsigned int circles) -> Operation {
+            std::mt19937 random(BENCH_SEED);
+            std::shared_ptr<Map> map = std::make_shared<Map>(random_map(circles, 0, random));
+            return [map] {
+                const Location start = { 0, 0 };
+                const Location end = { MAP_WIDTH, MAP_HEIGHT };
+                double hits = 0;
+                for (const auto& player_ships : map->ships) {
+                    for (const Ship& ship : player_ships.second) {
+                        hits += collision::segment_circle_intersect(start, end, ship, constants::FORECAST_FUDGE_FACTOR);
+                    }
+                }
+                return hits;
+            };
+        } });
+
+        all.push_back({ "ship_collision_time", { 16, 256, 4096 }, [](const unsigned int pairs) -> Operation {
+            std::mt19937 random(BENCH_SEED);
+            std::shared_ptr<Map> map = std::make_shared<Map>(random_map(2 * pairs, 0, random));
+            std::uniform_int_distribution<int> angle(0, 359);
+            for (auto& player_ships : map->ships) {
+                for (Ship& ship : player_ships.second) {
+                    actions::set_velocity(ship.velocity, constants::MAX_SPEED, angle(random));
+                }
+            }
+            return [map] {
+                const std::vector<Ship>& first = map->ships.at(0);
+                const std::vector<Ship>& second = map->ships.at(1);
+                const long double radius = 2 * constants::SHIP_RADIUS;
+                double total = 0;
+                for (size_t i = 0; i < first.size() && i < second.size(); ++i) {
+                    total += collision::ship_collision_time(radius, first[i], second[i]).second;
+                }
+                for (size_t i = 0; i < map->ships.at(2).size() && i < map->ships.at(3).size(); ++i) {
+                    total += collision::ship_collision_time(radius, map->ships.at(2)[i], map->ships.at(3)[i]).second;
+                }
+                return total;
+            };
+        } });
+
+        all.push_back({ "will_collide", { 0, 10, 40, 160 }, [](const unsigned int crowd) -> Operation {
+            std::mt19937 random(BENCH_SEED);
+            std::shared_ptr<Map> map = std::make_shared<Map>(crowded_map(crowd, 0, random));
+            return [map] {
+                Ship& ship = map->ships.at(0).front();
+                const Location target = crowd_target();
+                actions::set_velocity(ship.velocity, constants::MAX_SPEED, ship.location.orient_towards_in_deg(target));
+                return (double) collision::will_collide(*map, ship, target);
+            };
+        } });
+
+        // the crowd is our own, since a crowd with enemies in it goes to local avoidance instead of the search
+        all.push_back({ "navigate_ship_towards_target", { 0, 10, 40, 160 }, [](const unsigned int crowd) -> Operation {
+            std::mt19937 random(BENCH_SEED);
+            std::shared_ptr<Map> map = std::make_shared<Map>(crowded_map(crowd, 0, random));
+            std::shared_ptr<Map> empty = std::make_shared<Map>(MAP_WIDTH, MAP_HEIGHT);
+            return [map, empty] {
+                // forget the last answer so every call searches
+                navigation::NavigationCache::get().begin_turn(*empty, 0);
+                Ship& ship = map->ships.at(0).front();
+                const possibly<Move> move = navigation::navigate_ship_towards_target(
+                    *map, ship, crowd_target(), constants::MAX_SPEED, true, constants::MAX_NAVIGATION_CORRECTIONS, M_PI / 180.0);
+                return (double) move.first.move_angle_deg;
+            };
+        } });
+
+        all.push_back({ "navigate_ship_towards_target_cached", { 0, 10, 40, 160 }, [](const unsigned int crowd) -> Operation {
+            std::mt19937 random(BENCH_SEED);
+            std::shared_ptr<Map> map = std::make_shared<Map>(crowded_map(crowd, 0, random));
+            navigation::NavigationCache::get().begin_turn(*map, 0);
+            return [map] {
+                Ship& ship = map->ships.at(0).front();
+                const possibly<Move> move = navigation::navigate_ship_towards_target(
+                    *map, ship, crowd_target(), constants::MAX_SPEED, true, constants::MAX_NAVIGATION_CORRECTIONS, M_PI / 180.0);
+                return (double) move.first.move_angle_deg;
+            };
+        } });
+
+        all.push_back({ "get_safe_location", { 0, 10, 40, 160 }, [](const unsigned int enemies) -> Operation {
+            std::mt19937 random(BENCH_SEED);
+            std::shared_ptr<Map> map = std::make_shared<Map>(crowded_map(enemies, 1, random));
+            combat::InfluenceMap::get().build(*map, 0);
+            return [map] {
+                Ship& ship = map->ships.at(0).front();
+                const Location safe = combat::get_safe_location(*map, ship, crowd_target());
+                return safe.pos_x + safe.pos_y;
+            };
+        } });
+
+        all.push_back({ "send_moves", { 10, 100, 1000 }, [](const unsigned int count) -> Operation {
+            std::shared_ptr<std::vector<Move>> moves = std::make_shared<std::vector<Move>>();
+            for (unsigned int i = 0; i < count; ++i) {
+                switch (i % 4) {
+                    case 0:
+                        moves->push_back(Move::dock(i, i % 28));
+                        break;
+                    case 1:
+                        moves->push_back(Move::undock(i));
+                        break;
+                    default:
+                        moves->push_back(Move::thrust(i, constants::MAX_SPEED, (i * 37) % 360));
+                        break;
+                }
+            }
+            return [moves] {
+                return (double) out::send_moves(*moves);
+            };
+        } });
+
+        return all;
+    }
+
+    static void print(std::ostream& out, const Result& result) {
+        out << result.name << "\t" << result.entities << "\t" << result.iterations << "\t"
+            << result.ns_per_op << "\t" << result.min_ns_per_op << std::endl;
+    }
+
+    static int run(const std::string& filter) {
+        // send_moves writes to stdout, which is where the results go
+        std::ostream results(std::cout.rdbuf());
+        NullBuffer null_buffer;
+        std::cout.rdbuf(&null_buffer);
+
+        results << std::fixed << std::setprecision(1);
+        results << "case\tentities\titerations\tns_per_op\tmin_ns_per_op" << std::endl;
+        for (const Case& bench_case : cases()) {
+            if (bench_case.name.find(filter) == std::string::npos) {
+                continue;
+            }
+            for (const unsigned int entities : bench_case.entity_counts) {
+                print(results, measure(bench_case.name, entities, bench_case.setup(entities)));
+            }
+        }
+
+        std::cout.rdbuf(results.rdbuf());
+        return 0;
+    }
+
+    /// ns_per_op by case and entity count, from a file written by run().
+    static bool read_results(const std::string& filename, std::map<std::pair<std::string, unsigned int>, double>& results) {
+        std::ifstream in(filename);
+        if (!in) {
+            std::cerr << "can't read " << filename << std::endl;
+            return false;
+        }
+
+        std::string line;
+        std::getline(in, line);
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            Result result;
+            if (fields >> result.name >> result.entities >> result.iterations >> result.ns_per_op) {
+                results[{ result.name, result.entities }] = result.ns_per_op;
+            }
+        }
+        return true;
+    }
+
+    /// Every case both files have, with the change in ns_per_op from before to after.
+    static int compare(const std::string& before_file, const std::string& after_file) {
+        std::map<std::pair<std::string, unsigned int>, double> before;
+        std::map<std::pair<std::string, unsigned int>, double> after;
+        if (!read_results(before_file, before) || !read_results(after_file, after)) {
+            return 1;
+        }
+
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << "case\tentities\tbefore_ns\tafter_ns\tchange_percent" << std::endl;
+        for (const auto& entry : after) {
+            const auto old = before.find(entry.first);
+            if (old == before.end()) {
+                continue;
+            }
+            const double change = old->second > 0 ? (entry.second - old->second) / old->second * 100 : 0;
+            std::cout << entry.first.first << "\t" << entry.first.second << "\t" << old->second << "\t"
+                      << entry.second << "\t" << change << std::endl;
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    const std::vector<std::string> args(argv + 1, argv + argc);
+
+    if (!args.empty() && args[0] == "compare") {
+        if (args.size() != 3) {
+            std::cerr << "usage: hlt_bench compare <before.tsv> <after.tsv>" << std::endl;
+            return 1;
+        }
+        return bench::compare(args[1], args[2]);
+    }
+
+    return bench::run(args.empty() ? "" : args[0]);
+}
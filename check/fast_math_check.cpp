@@ -0,0 +1,106 @@
+#include "hlt/fast_math.hpp"
+#include "hlt/util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+
+// Sweeps fast_math against libm over every offset two entities on a map can
+// have, and every angle a heading or a velocity is built from. Exits non-zero
+// if a single rounded engine heading comes out different, or if sincos
+// drifts past its documented bound.
+
+namespace check {
+    using namespace hlt;
+
+    /** Largest offset between two entities, per axis; maps are at most 384 x 256 */
+    constexpr double CHECK_MAX_OFFSET = 400.0;
+
+    /** Spacing of the grid of offsets swept */
+    constexpr double CHECK_GRID_STEP = 0.25;
+
+    /** Uniformly random offsets tried on top of the grid */
+    constexpr int CHECK_RANDOM_OFFSETS = 5000000;
+
+    /** Spacing of the angles sincos is swept over, in radians */
+    constexpr double CHECK_ANGLE_STEP = 1e-5;
+
+    /** What fast_math.hpp promises for sincos */
+    constexpr double CHECK_SINCOS_BOUND = 1e-13;
+
+    struct Result {
+        std::uint64_t cases = 0;
+        std::uint64_t mismatches = 0;
+        double max_error = 0;
+    };
+
+    static void check_atan2(Result& result, const double dy, const double dx) {
+        const double fast = fast_math::atan2(dy, dx);
+        const double exact = std::atan2(dy, dx);
+
+        result.cases++;
+        result.max_error = std::max(result.max_error, std::fabs(fast - exact));
+        if (util::angle_rad_to_deg_clipped(fast + 2 * M_PI) != util::angle_rad_to_deg_clipped(exact + 2 * M_PI)) {
+            if (result.mismatches++ < 10) {
+                std::cerr << "atan2 heading mismatch at dy=" << dy << " dx=" << dx << std::endl;
+            }
+        }
+    }
+
+    static void check_sincos(Result& result, const double angle) {
+        double fast_sin, fast_cos;
+        fast_math::sincos(angle, fast_sin, fast_cos);
+        const double exact_sin = std::sin(angle);
+        const double exact_cos = std::cos(angle);
+
+        const double error = std::max(std::fabs(fast_sin - exact_sin), std::fabs(fast_cos - exact_cos));
+        result.cases++;
+        result.max_error = std::max(result.max_error, error);
+        const bool heading_differs = util::angle_rad_to_deg_clipped(std::atan2(fast_sin, fast_cos)) !=
+                                     util::angle_rad_to_deg_clipped(std::atan2(exact_sin, exact_cos));
+        if (error > CHECK_SINCOS_BOUND || heading_differs) {
+            if (result.mismatches++ < 10) {
+                std::cerr << "sincos off by " << error << " at angle=" << angle << std::endl;
+            }
+        }
+    }
+}
+
+int main() {
+    using namespace check;
+
+    Result atan2_result;
+    const int steps = static_cast<int>(2 * CHECK_MAX_OFFSET / CHECK_GRID_STEP);
+    for (int i = 0; i <= steps; ++i) {
+        const double dy = -CHECK_MAX_OFFSET + i * CHECK_GRID_STEP;
+        for (int j = 0; j <= steps; ++j) {
+            check_atan2(atan2_result, dy, -CHECK_MAX_OFFSET + j * CHECK_GRID_STEP);
+        }
+    }
+
+    std::mt19937_64 rng(30);
+    std::uniform_real_distribution<double> offset(-CHECK_MAX_OFFSET, CHECK_MAX_OFFSET);
+    for (int i = 0; i < CHECK_RANDOM_OFFSETS; ++i) {
+        const double dy = offset(rng);
+        check_atan2(atan2_result, dy, offset(rng));
+    }
+
+    Result sincos_result;
+    // every whole heading as the engine and accelerate_by see it
+    for (int deg = -360; deg <= 720; ++deg) {
+        check_sincos(sincos_result, deg * M_PI / 180.0);
+    }
+    // orient_towards_in_rad hands get_closest_point angles in [pi, 3pi)
+    for (double angle = -4 * M_PI; angle <= 4 * M_PI; angle += CHECK_ANGLE_STEP) {
+        check_sincos(sincos_result, angle);
+    }
+
+    std::cout << "atan2: " << atan2_result.cases << " cases, " << atan2_result.mismatches
+              << " heading mismatches, max error " << atan2_result.max_error << " rad" << std::endl;
+    std::cout << "sincos: " << sincos_result.cases << " cases, " << sincos_result.mismatches
+              << " mismatches, max error " << sincos_result.max_error << std::endl;
+
+    return atan2_result.mismatches == 0 && sincos_result.mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#include "hlt/hlt_in.hpp"
+#include "hlt/simulator.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Replays engine frame pairs through the simulator and compares what it
+// ends up with against the engine's next frame. Takes the file of pairs,
+// check/simulator_frames.txt by default; see the top of that file for its
+// layout. Exits non-zero if any ship or planet comes out different.
+
+namespace check {
+    using namespace hlt;
+
+    struct FramePair {
+        std::string name;
+        int map_width = 0;
+        int map_height = 0;
+        std::string before;
+        std::vector<std::pair<PlayerId, std::string>> commands;
+        std::string after;
+    };
+
+    static bool read_pairs(const std::string& filename, std::vector<FramePair>& pairs) {
+        std::ifstream in(filename);
+        if (!in) {
+            return false;
+        }
+
+        std::string line;
+        FramePair pair;
+        int frames = 0;
+        bool has_size = false;
+        while (std::getline(in, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            if (line[0] == '#') {
+                const size_t name_start = line.find_first_not_of("# ");
+                pair = FramePair();
+                pair.name = name_start == std::string::npos ? "" : line.substr(name_start);
+                frames = 0;
+                has_size = false;
+                continue;
+            }
+            if (!has_size) {
+                std::istringstream(line) >> pair.map_width >> pair.map_height;
+                has_size = true;
+                continue;
+            }
+            if (line.compare(0, 6, "moves ") == 0) {
+                std::istringstream iss(line.substr(6));
+                int player_id;
+                iss >> player_id;
+                std::string commands;
+                std::getline(iss, commands);
+                pair.commands.emplace_back(static_cast<PlayerId>(player_id), commands);
+                continue;
+            }
+
+            if (frames++ == 0) {
+                pair.before = line;
+            } else {
+                pair.after = line;
+                pairs.push_back(pair);
+            }
+        }
+        return true;
+    }
+
+    static std::vector<Move> parse_commands(const std::string& commands) {
+        std::vector<Move> moves;
+        std::istringstream iss(commands);
+        std::string type;
+        while (iss >> type) {
+            EntityId ship_id;
+            iss >> ship_id;
+            if (type == "t") {
+                int thrust, angle_deg;
+                iss >> thrust >> angle_deg;
+                moves.push_back(Move::thrust(ship_id, thrust, angle_deg));
+            } else if (type == "d") {
+                EntityId planet_id;
+                iss >> planet_id;
+                moves.push_back(Move::dock(ship_id, planet_id));
+            } else if (type == "u") {
+                moves.push_back(Move::undock(ship_id));
+            }
+        }
+        return moves;
+    }
+
+    /// Planets in next_map that state gets wrong: gone, still there, or off in health, owner or production.
+    static int count_planet_mismatches(const simulation::GameState& state, const Map& next_map) {
+        int mismatches = 0;
+        for (int p = 0; p < state.planet_count; ++p) {
+            const simulation::SimPlanet& planet = state.planets[p];
+            const auto index = next_map.planet_map.find(planet.entity_id);
+            if (index == next_map.planet_map.end()) {
+                mismatches += planet.alive;
+                continue;
+            }
+
+            const Planet& next = next_map.planets[index->second];
+            const PlayerId next_owner = next.is_owned ? next.owner_id : -1;
+            if (!planet.alive || planet.health != next.health || planet.owner_id != next_owner ||
+                planet.current_production != next.current_production) {
+                mismatches++;
+            }
+        }
+        return mismatches;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    using namespace check;
+
+    const std::string filename = argc > 1 ? argv[1] : "check/simulator_frames.txt";
+    std::vector<FramePair> pairs;
+    if (!read_pairs(filename, pairs) || pairs.empty()) {
+        std::cerr << "no frame pairs in " << filename << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<simulation::GameState> state(new simulation::GameState());
+    int failed = 0;
+    for (const FramePair& pair : pairs) {
+        const Map before = in::parse_map(pair.before, pair.map_width, pair.map_height);
+        const Map after = in::parse_map(pair.after, pair.map_width, pair.map_height);
+
+        state->load(before);
+        for (const auto& commands : pair.commands) {
+            for (const Move& move : parse_commands(commands.second)) {
+                state->apply_move(commands.first, move);
+            }
+        }
+        state->step();
+
+        int compared = 0;
+        const int ship_mismatches = state->count_mismatches(after, compared);
+        const int planet_mismatches = count_planet_mismatches(*state, after);
+        const bool passed = ship_mismatches == 0 && planet_mismatches == 0;
+        failed += !passed;
+
+        std::cout << (passed ? "ok    " : "FAIL  ") << pair.name << ": " << ship_mismatches << " of " << compared
+                  << " ships and " << planet_mismatches << " of " << state->planet_count << " planets mismatched"
+                  << std::endl;
+    }
+
+    std::cout << pairs.size() - failed << " of " << pairs.size() << " frame pairs replayed exactly" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cmath>
+
+#include "constants.hpp"
+#include "entity.hpp"
+#include "location.hpp"
+#include "types.hpp"
+
+namespace hlt {
+    namespace actions {
+        constexpr int THRUST_LEVELS = constants::MAX_SPEED + 1;
+        constexpr int HEADINGS = 360;
+
+        /// Every move the engine accepts, as the displacement it causes in one turn.
+        struct DisplacementTable {
+            double dx[THRUST_LEVELS][HEADINGS];
+            double dy[THRUST_LEVELS][HEADINGS];
+        };
+
+        static DisplacementTable build_displacement_table() {
+            DisplacementTable table;
+            for (int thrust = 0; thrust < THRUST_LEVELS; ++thrust) {
+                for (int angle_deg = 0; angle_deg < HEADINGS; ++angle_deg) {
+                    table.dx[thrust][angle_deg] = thrust * std::cos(angle_deg * M_PI / 180.0);
+                    table.dy[thrust][angle_deg] = thrust * std::sin(angle_deg * M_PI / 180.0);
+                }
+            }
+            return table;
+        }
+
+        /// Filled in on first use; std::cos is not constexpr in C++11.
+        static const DisplacementTable& displacements() {
+            static const DisplacementTable table = build_displacement_table();
+            return table;
+        }
+
+        static int wrap_angle(const int angle_deg) {
+            const int wrapped = angle_deg % HEADINGS;
+            return wrapped < 0 ? wrapped + HEADINGS : wrapped;
+        }
+
+        /// Unit vector for a whole-degree heading.
+        static Location unit_vector(const int angle_deg) {
+            const int angle = wrap_angle(angle_deg);
+            return { displacements().dx[1][angle], displacements().dy[1][angle] };
+        }
+
+        /// Where a ship at from ends up after a thrust move.
+        static Location displaced(const Location& from, const int thrust, const int angle_deg) {
+            const int angle = wrap_angle(angle_deg);
+            return { from.pos_x + displacements().dx[thrust][angle], from.pos_y + displacements().dy[thrust][angle] };
+        }
+
+        /// Same as resetting the velocity and calling vel::accelerate_by, without the trig.
+        static void set_velocity(vel& velocity, const int thrust, const int angle_deg) {
+            if (thrust < 0 || thrust > constants::MAX_SPEED) {
+                velocity.vel_x = 0;
+                velocity.vel_y = 0;
+                velocity.accelerate_by(thrust, angle_deg * M_PI / 180.0);
+                return;
+            }
+
+            const int angle = wrap_angle(angle_deg);
+            velocity.vel_x = displacements().dx[thrust][angle];
+            velocity.vel_y = displacements().dy[thrust][angle];
+        }
+
+        struct Action {
+            int thrust;
+            int angle_deg;
+            Location destination;
+            double cost;
+        };
+
+        /**
+         * Score thrusts [min_thrust, max_thrust] at angle_count headings starting
+         * from first_angle_deg and going counter-clockwise, and return the
+         * cheapest. Ties go to whichever was evaluated first. Nothing is
+         * returned if no action costs less than cost_bound.
+         *
+         * cost is anything callable as double(const Location& destination).
+         */
+        template<typename Cost>
+        static possibly<Action> best_action(
+                const Location& from,
+                const int min_thrust,
+                const int max_thrust,
+                const int first_angle_deg,
+                const int angle_count,
+                Cost cost,
+                const double cost_bound)
+        {
+            const DisplacementTable& table = displacements();
+            Action best = { 0, 0, from, cost_bound };
+            bool found = false;
+
+            double xs[HEADINGS];
+            double ys[HEADINGS];
+            const int count = std::min(angle_count, HEADINGS);
+            const int first_angle = wrap_angle(first_angle_deg);
+
+            for (int thrust = min_thrust; thrust <= max_thrust; ++thrust) {
+                // lay the destinations out flat first so this part vectorizes
+                const int head = std::min(count, HEADINGS - first_angle);
+                for (int i = 0; i < head; ++i) {
+                    xs[i] = from.pos_x + table.dx[thrust][first_angle + i];
+                    ys[i] = from.pos_y + table.dy[thrust][first_angle + i];
+                }
+                for (int i = head; i < count; ++i) {
+                    xs[i] = from.pos_x + table.dx[thrust][i - head];
+                    ys[i] = from.pos_y + table.dy[thrust][i - head];
+                }
+
+                for (int i = 0; i < count; ++i) {
+                    const Location destination = { xs[i], ys[i] };
+                    const double score = cost(destination);
+                    if (score < best.cost) {
+                        best = { thrust, wrap_angle(first_angle + i), destination, score };
+                        found = true;
+                    }
+                }
+            }
+
+            return { best, found };
+        }
+    }
+}
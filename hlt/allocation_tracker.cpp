@@ -0,0 +1,91 @@
+#include <cstdlib>
+#include <new>
+
+#include "allocation_tracker.hpp"
+
+// Replaces the global operator new and delete for the whole program. With
+// ENABLE_ALLOCATION_TRACKING off they only forward to malloc and free, like
+// the library's own. With it on, each block carries its size in a header in
+// front of it, so delete knows how many bytes stop being live.
+
+namespace {
+    const std::size_t HEADER_BYTES = alignof(std::max_align_t);
+
+    void* allocate(std::size_t size) {
+        if (size == 0) {
+            size = 1;
+        }
+        const std::size_t total = hlt::constants::ENABLE_ALLOCATION_TRACKING ? size + HEADER_BYTES : size;
+
+        for (;;) {
+            void* block = std::malloc(total);
+            if (block != nullptr) {
+                if (!hlt::constants::ENABLE_ALLOCATION_TRACKING) {
+                    return block;
+                }
+                *static_cast<std::size_t*>(block) = size;
+                hlt::memory::AllocationTracker::get().allocated(size);
+                return static_cast<char*>(block) + HEADER_BYTES;
+            }
+
+            const std::new_handler handler = std::get_new_handler();
+            if (handler == nullptr) {
+                throw std::bad_alloc();
+            }
+            handler();
+        }
+    }
+
+    void deallocate(void* pointer) {
+        if (pointer == nullptr) {
+            return;
+        }
+        if (!hlt::constants::ENABLE_ALLOCATION_TRACKING) {
+            std::free(pointer);
+            return;
+        }
+        char* block = static_cast<char*>(pointer) - HEADER_BYTES;
+        hlt::memory::AllocationTracker::get().freed(*reinterpret_cast<std::size_t*>(block));
+        std::free(block);
+    }
+
+    void* allocate_nothrow(const std::size_t size) {
+        try {
+            return allocate(size);
+        } catch (const std::bad_alloc&) {
+            return nullptr;
+        }
+    }
+}
+
+void* operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate_nothrow(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate_nothrow(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    deallocate(pointer);
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "constants.hpp"
+#include "profiling.hpp"
+
+namespace hlt {
+    namespace memory {
+        /**
+         * Counts heap allocations and bytes against the turn and the profiled
+         * phase they happen in, and keeps track of peak live bytes. Fed by the
+         * global operator new and delete in allocation_tracker.cpp, so nothing
+         * in here may allocate; the table is written to <name>.alloc.txt by an
+         * atexit hook, since the game ends by exiting.
+         *
+         * Allocations outside any timed phase are put down to "other".
+         */
+        class AllocationTracker {
+        private:
+            static constexpr unsigned int TURNS = constants::ALLOCATION_TRACKING_MAX_TURNS;
+            /// Every phase, and one more for allocations outside them all.
+            static constexpr unsigned int PHASES = profiling::PHASE_COUNT + 1;
+
+            struct Counts {
+                std::atomic<std::uint64_t> allocations;
+                std::atomic<std::uint64_t> bytes;
+            };
+
+            Counts counts[TURNS][PHASES];
+            std::atomic<std::uint64_t> turn_peaks[TURNS];
+            std::atomic<std::uint64_t> phase_peaks[PHASES];
+            std::atomic<std::uint64_t> live;
+            std::atomic<std::uint64_t> peak;
+            std::atomic<unsigned int> current_turn;
+            std::atomic<unsigned int> last_turn;
+            std::string name;
+
+            /// Only ever constructed as a static, which zeroes every count before any allocation.
+            AllocationTracker() = default;
+
+            static void raise(std::atomic<std::uint64_t>& maximum, const std::uint64_t value) {
+                std::uint64_t seen = maximum.load(std::memory_order_relaxed);
+                while (seen < value && !maximum.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+                }
+            }
+
+            static std::uint64_t load(const std::atomic<std::uint64_t>& value) {
+                return value.load(std::memory_order_relaxed);
+            }
+
+            static std::string phase_name(const unsigned int phase) {
+                return phase < profiling::PHASE_COUNT ? profiling::to_string(static_cast<profiling::Phase>(phase)) : "other";
+            }
+
+            static void write_at_exit() {
+                get().write();
+            }
+
+            void write() {
+                std::ofstream out(name + ".alloc.txt", std::ios::trunc | std::ios::out);
+                const unsigned int turns = std::min(last_turn.load() + 1, TURNS);
+
+                out << "heap allocations over " << turns << " turns; peak live " << load(peak) << " bytes\n\n";
+
+                out << "phase allocations bytes peak_live\n";
+                for (unsigned int phase = 0; phase < PHASES; ++phase) {
+                    std::uint64_t allocations = 0;
+                    std::uint64_t bytes = 0;
+                    for (unsigned int turn = 0; turn < turns; ++turn) {
+                        allocations += load(counts[turn][phase].allocations);
+                        bytes += load(counts[turn][phase].bytes);
+                    }
+                    out << phase_name(phase) << " " << allocations << " " << bytes << " " << load(phase_peaks[phase]) << "\n";
+                }
+
+                out << "\nturn allocations bytes peak_live";
+                for (unsigned int phase = 0; phase < PHASES; ++phase) {
+                    out << " " << phase_name(phase);
+                }
+                out << "\n";
+                for (unsigned int turn = 0; turn < turns; ++turn) {
+                    std::uint64_t allocations = 0;
+                    std::uint64_t bytes = 0;
+                    for (unsigned int phase = 0; phase < PHASES; ++phase) {
+                        allocations += load(counts[turn][phase].allocations);
+                        bytes += load(counts[turn][phase].bytes);
+                    }
+                    out << turn << " " << allocations << " " << bytes << " " << load(turn_peaks[turn]);
+                    for (unsigned int phase = 0; phase < PHASES; ++phase) {
+                        out << " " << load(counts[turn][phase].allocations);
+                    }
+                    out << "\n";
+                }
+            }
+
+        public:
+            static AllocationTracker& get() {
+                static AllocationTracker instance;
+                return instance;
+            }
+
+            AllocationTracker(const AllocationTracker&) = delete;
+            AllocationTracker& operator=(const AllocationTracker&) = delete;
+
+            /// The table is written to <file_name>.alloc.txt when the process exits.
+            void open(const std::string& file_name) {
+                name = file_name;
+                std::atexit(write_at_exit);
+            }
+
+            /// Called by the thread reading frames, as each one arrives.
+            void begin_turn(const unsigned int turn) {
+                const unsigned int index = std::min(turn, TURNS - 1);
+                current_turn = index;
+                last_turn = index;
+                raise(turn_peaks[index], live.load(std::memory_order_relaxed));
+            }
+
+            void allocated(const std::size_t bytes) {
+                const unsigned int turn = current_turn.load(std::memory_order_relaxed);
+                const unsigned int phase = profiling::ScopedTimer::current_phase();
+                counts[turn][phase].allocations.fetch_add(1, std::memory_order_relaxed);
+                counts[turn][phase].bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+                const std::uint64_t now_live = live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+                raise(turn_peaks[turn], now_live);
+                raise(phase_peaks[phase], now_live);
+                raise(peak, now_live);
+            }
+
+            void freed(const std::size_t bytes) {
+                live.fetch_sub(bytes, std::memory_order_relaxed);
+            }
+        };
+    }
+}
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "map.hpp"
+#include "threat_table.hpp"
+
+namespace hlt {
+    namespace assignment {
+        /// One place a ship can be sent; a planet with three free spots is three slots.
+        struct TargetSlot {
+            uint64_t key;
+            NearbyEntity entity;
+
+            double price;
+            /// Index into the bidders, -1 while nobody holds the slot.
+            int holder;
+        };
+
+        struct Edge {
+            int slot;
+            double benefit;
+        };
+
+        struct Bidder {
+            EntityId ship_id;
+            std::vector<Edge> edges;
+            /// Index into the slots, -1 while idle.
+            int slot;
+        };
+
+        /**
+         * Decides which target every undocked ship goes for, all ships at once,
+         * so they stop racing each other to the same planet or enemy.
+         *
+         * Each ship only sees its nearest few planets and enemies, and every
+         * target is split into as many slots as ships it can take. The result
+         * is found with an auction: unassigned ships bid on their best slot,
+         * pushing its price up and evicting whoever held it.
+         *
+         * A full solve is only done when the strategic plan is redone; on the
+         * turns between, update_fleet() frees the slots of ships that died
+         * and gives ships that spawned a free slot without bidding. Assignments and
+         * part of the prices carry over between turns, so most turns start out
+         * nearly solved and only a handful of bids are needed. Prices are cut
+         * by ASSIGNMENT_PRICE_DECAY on the way, since every solve only raises
+         * them and a contested slot would otherwise end up priced out.
+         */
+        class TargetAssignment {
+        private:
+            std::vector<TargetSlot> slots;
+            std::vector<Bidder> bidders;
+            std::unordered_map<uint64_t, int> slot_index;
+            std::unordered_map<EntityId, int> bidder_index;
+
+            /// Last turn's result, for the warm start; prices before the decay.
+            std::unordered_map<uint64_t, double> previous_prices;
+            std::unordered_map<EntityId, uint64_t> previous_slots;
+
+            static uint64_t planet_key(const EntityId planet_id, const unsigned int slot) {
+                return ((uint64_t) planet_id << 8) | slot;
+            }
+
+            static uint64_t ship_key(const PlayerId owner_id, const EntityId ship_id, const unsigned int slot) {
+                return (1ull << 62) | ((uint64_t) owner_id << 40) | ((uint64_t) ship_id << 8) | slot;
+            }
+
+            void add_slots(const NearbyEntity& entity, const uint64_t first_key, const unsigned int count) {
+                for (unsigned int i = 0; i < count; ++i) {
+                    const uint64_t key = first_key + i;
+                    const auto previous = previous_prices.find(key);
+                    slot_index[key] = slots.size();
+                    const double price = previous == previous_prices.end() ? 0.0 : previous->second * constants::ASSIGNMENT_PRICE_DECAY;
+                    slots.push_back({ key, entity, price, -1 });
+                }
+            }
+
+            void add_edges(Bidder& bidder, const uint64_t first_key, const unsigned int count, const double benefit) {
+                for (unsigned int i = 0; i < count; ++i) {
+                    const auto slot = slot_index.find(first_key + i);
+                    if (slot != slot_index.end()) {
+                        bidder.edges.push_back({ slot->second, benefit });
+                    }
+                }
+            }
+
+            /// Add ship as a bidder, with an edge to every slot of its nearest planets and enemies.
+            void add_bidder(Map& map, Ship& ship) {
+                ship.sort_nearby_entitys();
+
+                bidder_index[ship.entity_id] = bidders.size();
+                bidders.push_back({ ship.entity_id, {}, -1 });
+                Bidder& bidder = bidders.back();
+
+                // handle_ship turns planets down with an enemy this close, so don't offer them
+                const double planet_enemy_radius = constants::MAX_SPEED + 2 * ship.radius + constants::WEAPON_RADIUS;
+                const bool is_threatened = !ship.nearby_enemy_ships.empty() &&
+                    ship.nearby_enemy_ships[0].distance <= planet_enemy_radius;
+
+                if (!is_threatened) {
+                    const size_t planets = std::min(ship.nearby_planets.size(), (size_t) constants::ASSIGNMENT_CANDIDATES);
+                    for (size_t i = 0; i < planets; ++i) {
+                        const NearbyEntity& entity = ship.nearby_planets[i];
+                        const Planet& planet = map.get_planet(entity.entity_id);
+                        add_edges(bidder, planet_key(entity.entity_id, 0), planet.docking_spots,
+                            constants::ASSIGNMENT_PLANET_BONUS - entity.distance);
+                    }
+                }
+
+                const size_t enemies = std::min(ship.nearby_enemy_ships.size(), (size_t) constants::ASSIGNMENT_CANDIDATES);
+                for (size_t i = 0; i < enemies; ++i) {
+                    const NearbyEntity& entity = ship.nearby_enemy_ships[i];
+                    const Ship& enemy = map.get_ship(entity.owner_id, entity.entity_id);
+
+                    double benefit = -entity.distance;
+                    unsigned int count = constants::ASSIGNMENT_SHIPS_PER_ENEMY;
+                    if (enemy.docking_status != ShipDockingStatus::Undocked) {
+                        benefit += constants::ASSIGNMENT_DOCKED_ENEMY_BONUS;
+                        count = constants::ASSIGNMENT_SHIPS_PER_DOCKED_ENEMY;
+                    } else if (combat::ThreatTable::get().is_attacker(entity.owner_id, entity.entity_id, constants::THREAT_DEFEND_TURNS)) {
+                        // an enemy closing in on our docked ships matters more
+                        benefit += constants::ASSIGNMENT_DEFENSE_BONUS;
+                    }
+                    add_edges(bidder, ship_key(entity.owner_id, entity.entity_id, 0), count, benefit);
+                }
+            }
+
+            /// Best and second best value (benefit less price) for bidder, idling counting as an option.
+            void best_two(const Bidder& bidder, int& best_slot, double& best_value, double& second_value) const {
+                best_slot = -1;
+                best_value = -constants::ASSIGNMENT_IDLE_COST;
+                second_value = -std::numeric_limits<double>::max();
+
+                for (const Edge& edge : bidder.edges) {
+                    const double value = edge.benefit - slots[edge.slot].price;
+                    if (value > best_value) {
+                        second_value = best_value;
+                        best_value = value;
+                        best_slot = edge.slot;
+                    } else if (value > second_value) {
+                        second_value = value;
+                    }
+                }
+            }
+
+        public:
+            unsigned int bids = 0;
+            unsigned int kept = 0;
+            /// Slots freed by ships that died, and ships given a slot, by update_fleet().
+            unsigned int freed = 0;
+            unsigned int joined = 0;
+            double solve_us = 0;
+
+            static TargetAssignment& get() {
+                static TargetAssignment instance{};
+                return instance;
+            }
+
+            /**
+             * Assign every undocked ship of player_id. The ships'
+             * nearby lists must already be filled in.
+             */
+            void solve(Map& map, const PlayerId player_id) {
+                const auto start = std::chrono::steady_clock::now();
+
+                slots.clear();
+                bidders.clear();
+                slot_index.clear();
+                bidder_index.clear();
+                bids = 0;
+                kept = 0;
+                freed = 0;
+                joined = 0;
+
+                for (const Planet& planet : map.planets) {
+                    if (planet.is_owned && planet.owner_id != player_id) {
+                        continue;
+                    }
+                    if (planet.docked_ships.size() >= planet.docking_spots) {
+                        continue;
+                    }
+                    NearbyEntity entity;
+                    entity.is_ship = false;
+                    entity.entity_id = planet.entity_id;
+                    entity.owner_id = planet.owner_id;
+                    add_slots(entity, planet_key(planet.entity_id, 0), planet.docking_spots - planet.docked_ships.size());
+                }
+
+                for (const auto& player_ships : map.ships) {
+                    if (player_ships.first == player_id) {
+                        continue;
+                    }
+                    for (const Ship& ship : player_ships.second) {
+                        NearbyEntity entity;
+                        entity.is_ship = true;
+                        entity.entity_id = ship.entity_id;
+                        entity.owner_id = player_ships.first;
+                        const unsigned int count = ship.docking_status == ShipDockingStatus::Undocked ?
+                            constants::ASSIGNMENT_SHIPS_PER_ENEMY : constants::ASSIGNMENT_SHIPS_PER_DOCKED_ENEMY;
+                        add_slots(entity, ship_key(player_ships.first, ship.entity_id, 0), count);
+                    }
+                }
+
+                for (Ship& ship : map.ships.at(player_id)) {
+                    if (ship.docking_status == ShipDockingStatus::Undocked) {
+                        add_bidder(map, ship);
+                    }
+                }
+
+                // warm start: hand ships last turn's slot back if it is still about their best
+                std::deque<int> unassigned;
+                for (size_t b = 0; b < bidders.size(); ++b) {
+                    Bidder& bidder = bidders[b];
+                    const auto previous = previous_slots.find(bidder.ship_id);
+                    if (previous != previous_slots.end()) {
+                        const auto slot = slot_index.find(previous->second);
+                        if (slot != slot_index.end() && slots[slot->second].holder == -1) {
+                            int best_slot;
+                            double best_value, second_value;
+                            best_two(bidder, best_slot, best_value, second_value);
+
+                            for (const Edge& edge : bidder.edges) {
+                                if (edge.slot == slot->second &&
+                                    edge.benefit - slots[edge.slot].price >= best_value - constants::ASSIGNMENT_EPSILON) {
+                                    bidder.slot = edge.slot;
+                                    slots[edge.slot].holder = b;
+                                    kept++;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+
+                    if (bidder.slot == -1) {
+                        unassigned.push_back(b);
+                    }
+                }
+
+                while (!unassigned.empty()) {
+                    const int b = unassigned.front();
+                    unassigned.pop_front();
+                    Bidder& bidder = bidders[b];
+
+                    int best_slot;
+                    double best_value, second_value;
+                    best_two(bidder, best_slot, best_value, second_value);
+                    if (best_slot == -1) {
+                        // nothing is worth more than staying idle, and idling is never contested
+                        continue;
+                    }
+
+                    TargetSlot& slot = slots[best_slot];
+                    slot.price += best_value - second_value + constants::ASSIGNMENT_EPSILON;
+                    if (slot.holder != -1) {
+                        bidders[slot.holder].slot = -1;
+                        unassigned.push_back(slot.holder);
+                    }
+                    slot.holder = b;
+                    bidder.slot = best_slot;
+                    bids++;
+                }
+
+                previous_prices.clear();
+                previous_slots.clear();
+                for (const Bidder& bidder : bidders) {
+                    if (bidder.slot != -1) {
+                        const TargetSlot& slot = slots[bidder.slot];
+                        previous_prices[slot.key] = slot.price;
+                        previous_slots[bidder.ship_id] = slot.key;
+                    }
+                }
+
+                solve_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            /**
+             * Keep the last solve in step with our fleet until the next one:
+             * free the slots of ships that died, and hand each undocked ship
+             * that isn't a bidder yet the free slot worth most to it, if any
+             * beats staying idle. Nobody is bid out and no price changes.
+             */
+            void update_fleet(Map& map, const PlayerId player_id) {
+                const auto start = std::chrono::steady_clock::now();
+                bids = 0;
+                kept = 0;
+                freed = 0;
+                joined = 0;
+
+                const auto owned = map.ship_map.find(player_id);
+                for (Bidder& bidder : bidders) {
+                    if (bidder.slot == -1) {
+                        continue;
+                    }
+                    if (owned == map.ship_map.end() || owned->second.count(bidder.ship_id) == 0) {
+                        slots[bidder.slot].holder = -1;
+                        previous_slots.erase(bidder.ship_id);
+                        bidder.slot = -1;
+                        freed++;
+                    }
+                }
+
+                if (owned != map.ship_map.end()) {
+                    for (Ship& ship : map.ships.at(player_id)) {
+                        if (ship.docking_status != ShipDockingStatus::Undocked || bidder_index.count(ship.entity_id) > 0) {
+                            continue;
+                        }
+
+                        add_bidder(map, ship);
+                        Bidder& bidder = bidders.back();
+                        double best_value = -constants::ASSIGNMENT_IDLE_COST;
+                        for (const Edge& edge : bidder.edges) {
+                            const double value = edge.benefit - slots[edge.slot].price;
+                            if (slots[edge.slot].holder == -1 && value > best_value) {
+                                best_value = value;
+                                bidder.slot = edge.slot;
+                            }
+                        }
+
+                        if (bidder.slot != -1) {
+                            TargetSlot& slot = slots[bidder.slot];
+                            slot.holder = bidders.size() - 1;
+                            previous_slots[ship.entity_id] = slot.key;
+                            previous_prices[slot.key] = slot.price;
+                            joined++;
+                        }
+                    }
+                }
+
+                solve_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            /// The target ship was assigned, with its distance filled in for handle_ship.
+            possibly<NearbyEntity> target_of(const Ship& ship) const {
+                const auto bidder = bidder_index.find(ship.entity_id);
+                if (bidder == bidder_index.end() || bidders[bidder->second].slot == -1) {
+                    return { NearbyEntity(), false };
+                }
+
+                const NearbyEntity& entity = slots[bidders[bidder->second].slot].entity;
+                const std::vector<NearbyEntity>& nearby = entity.is_ship ? ship.nearby_enemy_ships : ship.nearby_planets;
+                for (const NearbyEntity& candidate : nearby) {
+                    if (candidate.entity_id == entity.entity_id && (!entity.is_ship || candidate.owner_id == entity.owner_id)) {
+                        return { candidate, true };
+                    }
+                }
+                return { NearbyEntity(), false };
+            }
+
+            unsigned int assigned_count() const {
+                unsigned int count = 0;
+                for (const Bidder& bidder : bidders) {
+                    count += bidder.slot != -1;
+                }
+                return count;
+            }
+
+            unsigned int ship_count() const {
+                return bidders.size();
+            }
+        };
+    }
+}
@@ -4,6 +4,7 @@
 
 #include "entity.hpp"
 #include "location.hpp"
+#include "profiling.hpp"
 
 constexpr auto EVENT_TIME_PRECISION = 10000;
 
@@ -116,7 +117,7 @@ namespace hlt {
             target.pos_x < map.map_width && target.pos_y < map.map_height);
         }
 
-        auto ship_collision_time(
+        static auto ship_collision_time(
             long double r,
             hlt::Ship ship1,
             hlt::Ship ship2
@@ -178,7 +179,7 @@ namespace hlt {
             }
         }
 
-        auto planet_collision_time(
+        static auto planet_collision_time(
             long double r,
             hlt::Ship ship1,
             hlt::Planet planet2
@@ -240,15 +241,15 @@ namespace hlt {
             }
         }
 
-        auto round_event_time(double t) -> double {
+        static auto round_event_time(double t) -> double {
             return std::round(t * EVENT_TIME_PRECISION) / EVENT_TIME_PRECISION;
         }
 
-        auto round_event_movment(double t) -> double {
+        static auto round_event_movment(double t) -> double {
             return std::round(t * EVENT_TIME_PRECISION) / EVENT_TIME_PRECISION;
         }
 
-        auto might_collide(long double distance, const hlt::Ship& ship1, const hlt::Ship& ship2) -> bool {
+        static auto might_collide(long double distance, const hlt::Ship& ship1, const hlt::Ship& ship2) -> bool {
             return distance <= // ship1.magnitude() + ship2.magnitude() +
                 sqrt(7 * 7 + 7 * 7) + sqrt(7 * 7 + 7 * 7) +
                 ship1.radius + ship2.radius + 0.01;
@@ -259,6 +260,8 @@ namespace hlt {
                 Ship& ship1,
                 const Location& target)
         {
+            profiling::count(profiling::Counter::WillCollide);
+
             if (out_of_bounds(map, target)) {
                 return true;
             }
@@ -44,12 +44,193 @@ namespace hlt {
         /** Distance from the planets edge at which new ships are created */
         constexpr int SPAWN_RADIUS = 2;
 
+        /** Production a planet has to accumulate to spawn a ship */
+        constexpr int PRODUCTION_PER_SHIP = 72;
+
         ////////////////////////////////////////////////////////////////////////
         // Implementation-specific constants
 
         constexpr double FORECAST_FUDGE_FACTOR = SHIP_RADIUS + 0.1;
         constexpr int MAX_NAVIGATION_CORRECTIONS = 90;
 
+        /** Grid size ship positions are snapped to when hashing a ship's surroundings */
+        constexpr double NAVIGATION_CACHE_CELL = 1.0;
+
+        /** How far a target may drift between turns and still reuse the cached heading */
+        constexpr double NAVIGATION_CACHE_TARGET_TOLERANCE = 1.0;
+
+        /** Size of a flow field grid cell */
+        constexpr double FLOW_FIELD_CELL = 2.0;
+
+        /** Extra room flow fields leave around planets */
+        constexpr double FLOW_FIELD_PLANET_MARGIN = 1.0;
+
+        /** Number of cells followed down a flow field to pick a ship's next waypoint */
+        constexpr int FLOW_FIELD_LOOKAHEAD = 4;
+
+        /** Hand ships in crowded fights to the ORCA local avoidance pass instead of searching headings */
+        constexpr bool ENABLE_ORCA_AVOIDANCE = true;
+
+        /** Distance within which other ships count towards a crowded fight */
+        constexpr double ORCA_NEIGHBOUR_RADIUS = 2 * MAX_SPEED + 1;
+
+        /** Number of nearby undocked ships (at least one an enemy) that makes a fight crowded */
+        constexpr int ORCA_DENSE_NEIGHBOURS = 6;
+
+        /** Number of turns ahead the avoidance pass keeps ships apart */
+        constexpr double ORCA_TIME_HORIZON = 2.0;
+
+        /** Distance between neighbouring docking approach points around a planet */
+        constexpr double DOCKING_SLOT_SPACING = 2.0;
+
+        /** Spacing of the points the influence map samples threat at */
+        constexpr double INFLUENCE_MAP_CELL = 1.0;
+
+        /** Ships within this distance of a target take part in a simulated fight over it */
+        constexpr double ENGAGEMENT_RADIUS = 2 * MAX_SPEED + WEAPON_RADIUS;
+
+        /** Number of turns a fight is simulated before deciding whether to join it */
+        constexpr int ENGAGEMENT_TURNS = 5;
+
+        /** Number of turns the opening rush is simulated for */
+        constexpr int RUSH_SIMULATION_TURNS = 40;
+
+        /** Replay every frame through the simulator and log how many ships it got wrong */
+        constexpr bool ENABLE_SIMULATOR_CHECK = false;
+
+        /** How far a simulated ship may be from the engine's position and still count as a match */
+        constexpr double SIMULATOR_POSITION_TOLERANCE = 0.01;
+
+        /** Threads running tasks, counting the one waiting on them; 0 for one per core */
+        constexpr unsigned int THREAD_POOL_SIZE = 0;
+
+        /** Plan ships on the thread pool when it has more than one worker */
+        constexpr bool ENABLE_PARALLEL_PLANNING = true;
+
+        /** Turn on which to time parallel planning on 1 to N threads and log the speedup; 0 never */
+        constexpr int PLANNING_SPEEDUP_REPORT_TURN = 0;
+
+        /** Time the engine allows for each turn */
+        constexpr double TURN_TIME_LIMIT_MS = 2000;
+
+        /** Moves go out at least this long before the engine's limit */
+        constexpr double TURN_SAFETY_MARGIN_MS = 300;
+
+        /** Share of the usable turn time after which planning starts cutting its searches short */
+        constexpr double TURN_DEGRADE_FRACTION = 0.5;
+
+        /** Fewest heading corrections a search is cut down to before the deadline */
+        constexpr int TURN_MIN_CORRECTIONS = 10;
+
+        /** Ships with an enemy this close are planned before the rest */
+        constexpr double TURN_PRIORITY_RADIUS = 2 * MAX_SPEED + WEAPON_RADIUS;
+
+        /** Build next turn's influence map and flow fields in the background while waiting for its frame */
+        constexpr bool ENABLE_SPECULATION = true;
+
+        /** Let parallel planning split the fleet into regions once the map is crowded */
+        constexpr bool ENABLE_REGION_PLANNING = true;
+
+        /** Ships on the map, all players together, before parallel planning splits the fleet into regions */
+        constexpr unsigned int REGION_PLANNING_MIN_SHIPS = 80;
+
+        /** Regions are split until none holds more of our ships than this */
+        constexpr unsigned int REGION_MAX_SHIPS = 8;
+
+        /** How far around its box a region's map reaches: a turn of movement plus weapon reach */
+        constexpr double REGION_HALO = MAX_SPEED + WEAPON_RADIUS + 2 * SHIP_RADIUS;
+
+        /**
+         * Time the phases of each turn and count hot calls, written out at
+         * game end. Every timer and counter checks this first, so with it off
+         * they compile to nothing.
+         */
+        constexpr bool ENABLE_PROFILING = false;
+
+        /** Timed events each thread keeps before dropping the rest */
+        constexpr unsigned int PROFILING_MAX_EVENTS_PER_THREAD = 1 << 20;
+
+        /**
+         * Count every heap allocation against the turn and profiled phase it
+         * happened in, written out at game end. Global operator new is
+         * replaced either way, but with this off it goes straight to malloc.
+         */
+        constexpr bool ENABLE_ALLOCATION_TRACKING = false;
+
+        /** Turns the allocation tracker keeps apart; later turns are added to the last */
+        constexpr unsigned int ALLOCATION_TRACKING_MAX_TURNS = 400;
+
+        /** Plan undocked ships by rolling out joint group moves in the simulator */
+        constexpr bool ENABLE_ROLLOUT_SEARCH = false;
+
+        /** Wall clock the rollout search may spend each turn */
+        constexpr double SEARCH_TURN_BUDGET_MS = 600;
+
+        /** Rollout depths, in turns, the search deepens between */
+        constexpr int SEARCH_MIN_DEPTH = 3;
+        constexpr int SEARCH_MAX_DEPTH = 12;
+
+        /** Undocked ships are searched over as at most this many groups */
+        constexpr int SEARCH_MAX_GROUPS = 4;
+
+        /** Ships closer than this to a group's center join it */
+        constexpr double SEARCH_GROUP_RADIUS = 15.0;
+
+        /** What a docked ship is worth at the end of a rollout, next to a point of health */
+        constexpr double SEARCH_DOCKED_SHIP_VALUE = 400.0;
+
+        /** Turns the fleet-level plan is kept for before it is redone regardless */
+        constexpr int STRATEGY_REPLAN_TURNS = 5;
+
+        /** Redo the plan early when any planet changes hands */
+        constexpr bool STRATEGY_REPLAN_ON_OWNERSHIP_CHANGE = true;
+
+        /** Redo the plan early when a fleet changes size by more than this fraction, or STRATEGY_SHIP_SWING_MIN ships */
+        constexpr bool STRATEGY_REPLAN_ON_SHIP_SWING = true;
+        constexpr double STRATEGY_SHIP_SWING = 0.2;
+        constexpr int STRATEGY_SHIP_SWING_MIN = 3;
+
+        /** Steer and gauge danger against where enemy ships are heading, not only where they are */
+        constexpr bool ENABLE_MOTION_PREDICTION = true;
+
+        /** Positions remembered per ship for predicting its motion */
+        constexpr int MOTION_HISTORY_LENGTH = 4;
+
+        /** Weight of each older displacement relative to the one after it */
+        constexpr double MOTION_HISTORY_DECAY = 0.5;
+
+        /** Turns ahead the economy forecast predicts spawns for */
+        constexpr int ECONOMY_FORECAST_TURNS = 60;
+
+        /** Defenders listed per docked ship in the threat table */
+        constexpr int THREAT_MAX_DEFENDERS = 3;
+
+        /** Docked ships an enemy could reach within this many turns get defended */
+        constexpr int THREAT_DEFEND_TURNS = 3;
+
+        /** Planets and enemies each ship is offered in the target assignment, nearest first */
+        constexpr int ASSIGNMENT_CANDIDATES = 8;
+
+        /** How many of our ships the assignment sends at one enemy */
+        constexpr unsigned int ASSIGNMENT_SHIPS_PER_ENEMY = 2;
+        constexpr unsigned int ASSIGNMENT_SHIPS_PER_DOCKED_ENEMY = 1;
+
+        /** Added to a target's benefit, which is otherwise minus its distance */
+        constexpr double ASSIGNMENT_PLANET_BONUS = 0.0;
+        constexpr double ASSIGNMENT_DOCKED_ENEMY_BONUS = 0.0;
+
+        /** Added for enemies that would be first to reach one of our docked ships within THREAT_DEFEND_TURNS */
+        constexpr double ASSIGNMENT_DEFENSE_BONUS = 10.0;
+
+        /** What leaving a ship without a target costs; larger than any distance on the map */
+        constexpr double ASSIGNMENT_IDLE_COST = 1000.0;
+
+        /** Minimum auction bid increment; the result is within ships * epsilon of the best */
+        constexpr double ASSIGNMENT_EPSILON = 0.25;
+
+        /** Share of its price a slot takes into the next solve; the rest is given back so prices can't creep up turn after turn */
+        constexpr double ASSIGNMENT_PRICE_DECAY = 0.5;
+
         /**
          * Used in Location::get_closest_point()
          * Minimum distance specified from the object's outer radius.
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "action_space.hpp"
+#include "map.hpp"
+
+namespace hlt {
+    namespace docking {
+        /// A point inside a planet's docking range that one ship can claim.
+        struct DockingSlot {
+            Location location;
+
+            bool is_reserved;
+            EntityId reserved_by;
+
+            /// Turn the holder last renewed its claim.
+            int reserved_turn;
+
+            /// The holder is docking or docked, so it is sitting on the slot.
+            bool holder_docked;
+        };
+
+        /**
+         * A ring of collision-free approach points around every planet, built
+         * once at pre-game, plus which of our ships has claimed which point.
+         *
+         * A claim lasts as long as its ship keeps renewing it every turn, or
+         * for as long as the ship stays docked to the planet. A ship planned
+         * without renewing its claim gives it up; see release_stale_claim().
+         *
+         * A copy can keep a journal of the slots it changes, so a worker
+         * planning ships one after another against the same copy only has to
+         * put back what the last ship touched; see record_changes().
+         */
+        class DockingSlots {
+        private:
+            entity_map<std::vector<DockingSlot>> slots;
+            int current_turn = 0;
+
+            bool is_recording = false;
+            /// Each slot changed since record_changes(), as it was before.
+            std::vector<std::pair<DockingSlot*, DockingSlot>> journal;
+
+            /// Note down slot as it is, if recording, before it is changed.
+            void touch(DockingSlot& slot) {
+                if (is_recording) {
+                    journal.emplace_back(&slot, slot);
+                }
+            }
+
+            void release(DockingSlot& slot) {
+                touch(slot);
+                slot.is_reserved = false;
+                slot.holder_docked = false;
+            }
+
+            /// The slot ship already holds on ring, else the free one nearest to it; -1 if none.
+            static int choose_slot(const std::vector<DockingSlot>& ring, const Ship& ship) {
+                int best = -1;
+                double best_distance = 0;
+                for (size_t i = 0; i < ring.size(); ++i) {
+                    const DockingSlot& slot = ring[i];
+                    if (slot.is_reserved && slot.reserved_by == ship.entity_id) {
+                        return i;
+                    }
+                    if (slot.is_reserved) {
+                        continue;
+                    }
+
+                    const double distance = ship.location.get_distance_to(slot.location);
+                    if (best == -1 || distance < best_distance) {
+                        best = i;
+                        best_distance = distance;
+                    }
+                }
+                return best;
+            }
+
+            static DockingSlots*& thread_override() {
+                static thread_local DockingSlots* instance = nullptr;
+                return instance;
+            }
+
+        public:
+            /// Where a ship's claim made this turn is.
+            struct Claim {
+                EntityId planet_id;
+                Location location;
+            };
+
+            /// The shared slots, or this thread's private copy while one is installed.
+            static DockingSlots& get() {
+                static DockingSlots instance{};
+                DockingSlots* local = thread_override();
+                return local != nullptr ? *local : instance;
+            }
+
+            /**
+             * Make get() return slots on the calling thread, or the shared
+             * slots again for nullptr. Lets a worker plan ships against its
+             * own copy without touching everyone else's claims.
+             */
+            static void install_for_this_thread(DockingSlots* slots) {
+                thread_override() = slots;
+            }
+
+            DockingSlots() = default;
+
+            /// Copies the slots and claims; the copy starts without a journal.
+            DockingSlots(const DockingSlots& other) : slots(other.slots), current_turn(other.current_turn) {
+            }
+
+            DockingSlots& operator=(const DockingSlots& other) {
+                slots = other.slots;
+                current_turn = other.current_turn;
+                is_recording = false;
+                journal.clear();
+                return *this;
+            }
+
+            /// Start noting down every slot changed from here on.
+            void record_changes() {
+                is_recording = true;
+                journal.clear();
+            }
+
+            /// Put back every slot changed since record_changes(), and keep recording.
+            void undo_changes() {
+                for (auto change = journal.rbegin(); change != journal.rend(); ++change) {
+                    *change->first = change->second;
+                }
+                journal.clear();
+            }
+
+            void build(const Map& map) {
+                slots.clear();
+
+                for (const Planet& planet : map.planets) {
+                    std::vector<DockingSlot>& ring = slots[planet.entity_id];
+
+                    // halfway into the docking range, with room for a ship to sit side by side
+                    const double ring_radius = planet.radius + constants::SHIP_RADIUS + constants::DOCK_RADIUS / 2;
+                    const int count = std::max(
+                            (int) planet.docking_spots,
+                            (int) (2 * M_PI * ring_radius / constants::DOCKING_SLOT_SPACING));
+
+                    for (int i = 0; i < count; ++i) {
+                        const int angle_deg = (i * actions::HEADINGS) / count;
+                        const Location direction = actions::unit_vector(angle_deg);
+                        const Location location = {
+                                planet.location.pos_x + direction.pos_x * ring_radius,
+                                planet.location.pos_y + direction.pos_y * ring_radius };
+
+                        if (location.pos_x < constants::SHIP_RADIUS || location.pos_y < constants::SHIP_RADIUS ||
+                            location.pos_x > map.map_width - constants::SHIP_RADIUS ||
+                            location.pos_y > map.map_height - constants::SHIP_RADIUS) {
+                            continue;
+                        }
+
+                        bool blocked = false;
+                        for (const Planet& other : map.planets) {
+                            if (other.entity_id != planet.entity_id &&
+                                location.get_distance_to(other.location) <= other.radius + constants::FORECAST_FUDGE_FACTOR) {
+                                blocked = true;
+                                break;
+                            }
+                        }
+
+                        if (!blocked) {
+                            ring.push_back({ location, false, 0, 0, false });
+                        }
+                    }
+                }
+            }
+
+            /// Drop claims held by ships that died, moved on or stopped renewing them.
+            void begin_turn(const Map& map, const PlayerId player_id) {
+                current_turn++;
+
+                const auto owned_ships = map.ship_map.find(player_id);
+                for (auto& ring : slots) {
+                    for (DockingSlot& slot : ring.second) {
+                        if (!slot.is_reserved) {
+                            continue;
+                        }
+
+                        if (owned_ships == map.ship_map.end()) {
+                            release(slot);
+                            continue;
+                        }
+
+                        const auto index = owned_ships->second.find(slot.reserved_by);
+                        if (index == owned_ships->second.end()) {
+                            release(slot);
+                            continue;
+                        }
+
+                        const Ship& holder = map.ships.at(player_id).at(index->second);
+                        slot.holder_docked = holder.docking_status != ShipDockingStatus::Undocked;
+                        if (slot.holder_docked) {
+                            if (holder.docked_planet != ring.first) {
+                                release(slot);
+                            }
+                        } else if (slot.reserved_turn < current_turn - 1) {
+                            release(slot);
+                        }
+                    }
+                }
+            }
+
+            /// Number of ships other than ship that have claimed a slot on planet and are still on their way.
+            unsigned int incoming(const Planet& planet, const Ship& ship) const {
+                const auto ring = slots.find(planet.entity_id);
+                if (ring == slots.end()) {
+                    return 0;
+                }
+
+                unsigned int count = 0;
+                for (const DockingSlot& slot : ring->second) {
+                    if (slot.is_reserved && !slot.holder_docked && slot.reserved_by != ship.entity_id) {
+                        count++;
+                    }
+                }
+                return count;
+            }
+
+            /// Whether the ships docked to the planet plus those already heading there fill it up.
+            bool is_full(const Planet& planet, const Ship& ship) const {
+                return planet.docked_ships.size() + incoming(planet, ship) >= planet.docking_spots;
+            }
+
+            /**
+             * Renew the ship's claim on a slot of planet, or claim the free slot
+             * nearest to it, and return where that slot is.
+             */
+            possibly<Location> reserve(const Planet& planet, const Ship& ship) {
+                const auto ring = slots.find(planet.entity_id);
+                if (ring == slots.end()) {
+                    return { ship.location, false };
+                }
+
+                const int chosen = choose_slot(ring->second, ship);
+                if (chosen < 0) {
+                    return { ship.location, false };
+                }
+                DockingSlot* best = &ring->second[chosen];
+
+                // a ship only ever holds one slot
+                for (auto& other_ring : slots) {
+                    for (DockingSlot& slot : other_ring.second) {
+                        if (&slot != best && slot.is_reserved && slot.reserved_by == ship.entity_id) {
+                            release(slot);
+                        }
+                    }
+                }
+
+                touch(*best);
+                best->is_reserved = true;
+                best->reserved_by = ship.entity_id;
+                best->reserved_turn = current_turn;
+                best->holder_docked = false;
+                return { best->location, true };
+            }
+
+            /**
+             * Give up the claim ship is still on its way to if it wasn't renewed
+             * this turn, so a ship that went for something else stops holding
+             * a slot until its claim runs out.
+             */
+            void release_stale_claim(const Ship& ship) {
+                for (auto& ring : slots) {
+                    for (DockingSlot& slot : ring.second) {
+                        if (slot.is_reserved && slot.reserved_by == ship.entity_id && !slot.holder_docked &&
+                            slot.reserved_turn != current_turn) {
+                            release(slot);
+                        }
+                    }
+                }
+            }
+
+            /// Where reserve() would put ship on planet right now, without claiming anything.
+            possibly<Location> peek(const Planet& planet, const Ship& ship) const {
+                const auto ring = slots.find(planet.entity_id);
+                if (ring == slots.end()) {
+                    return { ship.location, false };
+                }
+                const int chosen = choose_slot(ring->second, ship);
+                if (chosen < 0) {
+                    return { ship.location, false };
+                }
+                return { ring->second[chosen].location, true };
+            }
+
+            /// The slot ship claimed or renewed this turn, if any.
+            possibly<Claim> claim_of(const Ship& ship) const {
+                for (const auto& ring : slots) {
+                    for (const DockingSlot& slot : ring.second) {
+                        if (slot.is_reserved && slot.reserved_by == ship.entity_id && slot.reserved_turn == current_turn) {
+                            return { Claim{ ring.first, slot.location }, true };
+                        }
+                    }
+                }
+                return { Claim{ 0, ship.location }, false };
+            }
+
+            unsigned int slot_count() const {
+                unsigned int count = 0;
+                for (const auto& ring : slots) {
+                    count += ring.second.size();
+                }
+                return count;
+            }
+        };
+    }
+}
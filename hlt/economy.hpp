@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "map.hpp"
+
+namespace hlt {
+    namespace economy {
+        /// What drives one planet's production: who owns it, what it has banked and who is docked.
+        struct ProductionState {
+            PlayerId owner_id;
+            int current_production;
+            int remaining_production;
+            /// Ships fully docked, so producing.
+            int producing;
+            /// Turns left for each ship still docking, sorted.
+            std::vector<int> docking;
+
+            bool operator==(const ProductionState& other) const {
+                return owner_id == other.owner_id && current_production == other.current_production &&
+                    remaining_production == other.remaining_production && producing == other.producing &&
+                    docking == other.docking;
+            }
+
+            /// Play one turn of docking and production, the way the engine orders them.
+            int step() {
+                for (int& turns_left : docking) {
+                    turns_left--;
+                }
+                while (!docking.empty() && docking.front() <= 0) {
+                    docking.erase(docking.begin());
+                    producing++;
+                }
+
+                const int produced = std::min(remaining_production, producing * constants::BASE_PRODUCTIVITY);
+                current_production += produced;
+                remaining_production -= produced;
+
+                int spawned = 0;
+                while (current_production >= constants::PRODUCTION_PER_SHIP) {
+                    current_production -= constants::PRODUCTION_PER_SHIP;
+                    spawned++;
+                }
+                return spawned;
+            }
+        };
+
+        struct PlanetForecast {
+            /// What this turn's frame is expected to show, from last turn's forecast.
+            ProductionState expected;
+            /// The forecast played out to its last turn, so it can be extended one turn at a time.
+            ProductionState tail;
+            int tail_turn;
+
+            /// Absolute turns the planet spawns a ship on, one entry per ship.
+            std::vector<int> spawn_turns;
+            int last_seen_turn;
+        };
+
+        struct PlayerForecast {
+            int ships;
+            int next_spawn_turn;
+            /// Ships spawned by the end of each of the next ECONOMY_FORECAST_TURNS turns.
+            int spawned_by[constants::ECONOMY_FORECAST_TURNS + 1];
+        };
+
+        /**
+         * When each planet will next spawn a ship and how big every fleet will
+         * be over the next ECONOMY_FORECAST_TURNS turns.
+         *
+         * A planet's forecast is kept from one turn to the next and only
+         * played out again when the frame shows something it didn't predict,
+         * such as a ship docking, undocking or dying, or the planet changing
+         * hands. Otherwise it is only extended by one turn.
+         */
+        class EconomyForecast {
+        private:
+            entity_map<PlanetForecast> planets;
+            std::unordered_map<PlayerId, PlayerForecast> players;
+            int current_turn = 0;
+
+            static ProductionState observe(const Map& map, const Planet& planet) {
+                ProductionState state = { planet.is_owned ? planet.owner_id : -1,
+                    planet.current_production, planet.remaining_production, 0, {} };
+                if (!planet.is_owned) {
+                    return state;
+                }
+
+                const auto owner_ships = map.ship_map.find(planet.owner_id);
+                if (owner_ships == map.ship_map.end()) {
+                    return state;
+                }
+
+                for (const EntityId ship_id : planet.docked_ships) {
+                    const auto owned = owner_ships->second.find(ship_id);
+                    if (owned == owner_ships->second.end()) {
+                        continue;
+                    }
+                    const Ship& ship = map.ships.at(planet.owner_id)[owned->second];
+                    if (ship.docking_status == ShipDockingStatus::Docked) {
+                        state.producing++;
+                    } else if (ship.docking_status == ShipDockingStatus::Docking) {
+                        state.docking.push_back(ship.docking_progress);
+                    }
+                }
+                std::sort(state.docking.begin(), state.docking.end());
+                return state;
+            }
+
+            void extend(PlanetForecast& forecast, const int until_turn) {
+                while (forecast.tail_turn < until_turn) {
+                    forecast.tail_turn++;
+                    const int spawned = forecast.tail.owner_id < 0 ? 0 : forecast.tail.step();
+                    for (int i = 0; i < spawned; ++i) {
+                        forecast.spawn_turns.push_back(forecast.tail_turn);
+                    }
+                }
+            }
+
+        public:
+            unsigned int planets_replayed = 0;
+            unsigned int planets_extended = 0;
+
+            static EconomyForecast& get() {
+                static EconomyForecast instance{};
+                return instance;
+            }
+
+            void update(const Map& map, const int turn) {
+                current_turn = turn;
+                planets_replayed = 0;
+                planets_extended = 0;
+                const int horizon = turn + constants::ECONOMY_FORECAST_TURNS;
+
+                for (const Planet& planet : map.planets) {
+                    const ProductionState observed = observe(map, planet);
+                    const auto found = planets.find(planet.entity_id);
+
+                    if (found != planets.end() && found->second.last_seen_turn == turn - 1 &&
+                        found->second.expected == observed) {
+                        PlanetForecast& forecast = found->second;
+                        forecast.spawn_turns.erase(
+                            std::remove_if(forecast.spawn_turns.begin(), forecast.spawn_turns.end(),
+                                [turn](const int spawn_turn) { return spawn_turn <= turn; }),
+                            forecast.spawn_turns.end());
+                        extend(forecast, horizon);
+                        planets_extended++;
+                    } else {
+                        PlanetForecast& forecast = planets[planet.entity_id];
+                        forecast.tail = observed;
+                        forecast.tail_turn = turn;
+                        forecast.spawn_turns.clear();
+                        extend(forecast, horizon);
+                        planets_replayed++;
+                    }
+
+                    PlanetForecast& forecast = planets[planet.entity_id];
+                    forecast.last_seen_turn = turn;
+                    forecast.expected = observed;
+                    if (forecast.expected.owner_id >= 0) {
+                        forecast.expected.step();
+                    }
+                }
+
+                for (auto it = planets.begin(); it != planets.end();) {
+                    if (it->second.last_seen_turn != turn) {
+                        it = planets.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+
+                players.clear();
+                for (const auto& player_ships : map.ships) {
+                    PlayerForecast& player = players[player_ships.first];
+                    player.ships = player_ships.second.size();
+                    player.next_spawn_turn = -1;
+                    std::fill(player.spawned_by, player.spawned_by + constants::ECONOMY_FORECAST_TURNS + 1, 0);
+                }
+
+                for (const auto& entry : planets) {
+                    const PlanetForecast& forecast = entry.second;
+                    const auto player = players.find(forecast.tail.owner_id);
+                    if (player == players.end()) {
+                        continue;
+                    }
+                    for (const int spawn_turn : forecast.spawn_turns) {
+                        player->second.spawned_by[spawn_turn - turn]++;
+                        if (player->second.next_spawn_turn == -1 || spawn_turn < player->second.next_spawn_turn) {
+                            player->second.next_spawn_turn = spawn_turn;
+                        }
+                    }
+                }
+
+                for (auto& entry : players) {
+                    for (int i = 1; i <= constants::ECONOMY_FORECAST_TURNS; ++i) {
+                        entry.second.spawned_by[i] += entry.second.spawned_by[i - 1];
+                    }
+                }
+            }
+
+            /// Turn the planet next spawns a ship on, or -1 if not within the forecast.
+            int next_spawn_turn(const Planet& planet) const {
+                const auto found = planets.find(planet.entity_id);
+                if (found == planets.end() || found->second.spawn_turns.empty()) {
+                    return -1;
+                }
+                return found->second.spawn_turns.front();
+            }
+
+            /// Turn any of the player's planets next spawns a ship on, or -1 if not within the forecast.
+            int next_spawn_turn(const PlayerId player_id) const {
+                const auto found = players.find(player_id);
+                return found == players.end() ? -1 : found->second.next_spawn_turn;
+            }
+
+            /// The player's ship count in turns turns, if nothing dies; turns is clamped to the forecast.
+            int fleet_size_in(const PlayerId player_id, const int turns) const {
+                const auto found = players.find(player_id);
+                if (found == players.end()) {
+                    return 0;
+                }
+                const int clamped = std::max(0, std::min(turns, constants::ECONOMY_FORECAST_TURNS));
+                return found->second.ships + found->second.spawned_by[clamped];
+            }
+
+            /**
+             * Turns until a fresh planet spawns its first ship if ships start
+             * docking to it now, counting the docking itself.
+             */
+            static int turns_to_first_spawn(const int ships) {
+                if (ships <= 0) {
+                    return -1;
+                }
+                const int per_turn = ships * constants::BASE_PRODUCTIVITY;
+                return (int) constants::DOCK_TURNS + (constants::PRODUCTION_PER_SHIP + per_turn - 1) / per_turn;
+            }
+        };
+    }
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <cmath>
+
+#include "map.hpp"
+
+namespace hlt {
+    namespace combat {
+        constexpr int MAX_ENGAGEMENT_SHIPS = 32;
+
+        /// Just the parts of a ship that matter in a fight.
+        struct Combatant {
+            double pos_x, pos_y;
+            int health;
+            int weapon_cooldown;
+            PlayerId owner_id;
+            bool is_docked;
+        };
+
+        static Combatant to_combatant(const Ship& ship) {
+            return { ship.location.pos_x, ship.location.pos_y, ship.health, ship.weapon_cooldown, ship.owner_id,
+                     ship.docking_status != ShipDockingStatus::Undocked };
+        }
+
+        struct EngagementOutcome {
+            int turns;
+            int survivors[constants::MAX_PLAYERS];
+            int health_left[constants::MAX_PLAYERS];
+            int damage_dealt[constants::MAX_PLAYERS];
+
+            /// Whether player came out with ships left and nobody else did.
+            bool is_won_by(const PlayerId player_id) const {
+                for (int player = 0; player < constants::MAX_PLAYERS; ++player) {
+                    if (player != player_id && survivors[player] > 0) {
+                        return false;
+                    }
+                }
+                return survivors[player_id] > 0;
+            }
+        };
+
+        /**
+         * A small fight played out with the engine's weapon rules: every
+         * undocked ship whose weapon is ready splits WEAPON_DAMAGE evenly over
+         * all enemies within weapon range, docked ships never shoot, and all
+         * damage lands at once. Undocked ships close in on their nearest enemy
+         * at MAX_SPEED until it is within range.
+         *
+         * Lives on fixed arrays so it is cheap enough to run for every fight
+         * every turn; ships past MAX_ENGAGEMENT_SHIPS are ignored.
+         */
+        class Engagement {
+        private:
+            Combatant ships[MAX_ENGAGEMENT_SHIPS];
+            int count = 0;
+
+            static double weapon_reach() {
+                return constants::WEAPON_RADIUS + 2 * constants::SHIP_RADIUS;
+            }
+
+            static double distance2(const Combatant& a, const Combatant& b) {
+                const double dx = a.pos_x - b.pos_x;
+                const double dy = a.pos_y - b.pos_y;
+                return dx * dx + dy * dy;
+            }
+
+            void advance_ships() {
+                const double reach = weapon_reach();
+                for (int i = 0; i < count; ++i) {
+                    Combatant& ship = ships[i];
+                    if (ship.health <= 0 || ship.is_docked) {
+                        continue;
+                    }
+
+                    int nearest = -1;
+                    double nearest_distance2 = 0;
+                    for (int j = 0; j < count; ++j) {
+                        if (ships[j].health <= 0 || ships[j].owner_id == ship.owner_id) {
+                            continue;
+                        }
+                        const double d2 = distance2(ship, ships[j]);
+                        if (nearest == -1 || d2 < nearest_distance2) {
+                            nearest = j;
+                            nearest_distance2 = d2;
+                        }
+                    }
+
+                    if (nearest == -1) {
+                        continue;
+                    }
+
+                    const double distance = std::sqrt(nearest_distance2);
+                    const double step = std::min<double>(constants::MAX_SPEED, distance - reach + constants::SHIP_RADIUS);
+                    if (step > 0) {
+                        ship.pos_x += (ships[nearest].pos_x - ship.pos_x) / distance * step;
+                        ship.pos_y += (ships[nearest].pos_y - ship.pos_y) / distance * step;
+                    }
+                }
+            }
+
+            void fire_weapons(EngagementOutcome& outcome) {
+                const double reach2 = weapon_reach() * weapon_reach();
+                int damage[MAX_ENGAGEMENT_SHIPS] = {};
+
+                for (int i = 0; i < count; ++i) {
+                    Combatant& ship = ships[i];
+                    if (ship.health <= 0) {
+                        continue;
+                    }
+                    if (ship.weapon_cooldown > 0) {
+                        ship.weapon_cooldown--;
+                    }
+                    if (ship.is_docked || ship.weapon_cooldown > 0) {
+                        continue;
+                    }
+
+                    int targets[MAX_ENGAGEMENT_SHIPS];
+                    int target_count = 0;
+                    for (int j = 0; j < count; ++j) {
+                        if (ships[j].health > 0 && ships[j].owner_id != ship.owner_id && distance2(ship, ships[j]) <= reach2) {
+                            targets[target_count++] = j;
+                        }
+                    }
+
+                    if (target_count == 0) {
+                        continue;
+                    }
+
+                    const int share = constants::WEAPON_DAMAGE / target_count;
+                    for (int t = 0; t < target_count; ++t) {
+                        damage[targets[t]] += share;
+                    }
+                    outcome.damage_dealt[ship.owner_id] += share * target_count;
+                    ship.weapon_cooldown = constants::WEAPON_COOLDOWN;
+                }
+
+                for (int i = 0; i < count; ++i) {
+                    ships[i].health -= damage[i];
+                }
+            }
+
+            void tally(EngagementOutcome& outcome) const {
+                for (int player = 0; player < constants::MAX_PLAYERS; ++player) {
+                    outcome.survivors[player] = 0;
+                    outcome.health_left[player] = 0;
+                }
+                for (int i = 0; i < count; ++i) {
+                    if (ships[i].health > 0) {
+                        outcome.survivors[ships[i].owner_id]++;
+                        outcome.health_left[ships[i].owner_id] += ships[i].health;
+                    }
+                }
+            }
+
+            int players_alive() const {
+                int alive = 0;
+                bool seen[constants::MAX_PLAYERS] = {};
+                for (int i = 0; i < count; ++i) {
+                    if (ships[i].health > 0 && !seen[ships[i].owner_id]) {
+                        seen[ships[i].owner_id] = true;
+                        alive++;
+                    }
+                }
+                return alive;
+            }
+
+        public:
+            void clear() {
+                count = 0;
+            }
+
+            int size() const {
+                return count;
+            }
+
+            void add(const Combatant& combatant) {
+                if (count < MAX_ENGAGEMENT_SHIPS && combatant.owner_id >= 0 && combatant.owner_id < constants::MAX_PLAYERS) {
+                    ships[count++] = combatant;
+                }
+            }
+
+            void add(const Ship& ship) {
+                add(to_combatant(ship));
+            }
+
+            /// Every ship on the map within radius of center.
+            void add_around(const Map& map, const Location& center, const double radius) {
+                for (const auto& player_ship : map.ships) {
+                    for (const Ship& ship : player_ship.second) {
+                        if (ship.location.get_distance_to(center) <= radius) {
+                            add(ship);
+                        }
+                    }
+                }
+            }
+
+            /**
+             * Play the fight forward for up to max_turns, stopping early once
+             * only one player has ships left. Works on a copy, so the same
+             * engagement can be simulated again.
+             */
+            EngagementOutcome simulate(const int max_turns) const {
+                Engagement fight = *this;
+                EngagementOutcome outcome = {};
+
+                for (outcome.turns = 0; outcome.turns < max_turns && fight.players_alive() > 1; ++outcome.turns) {
+                    fight.advance_ships();
+                    fight.fire_weapons(outcome);
+                }
+
+                fight.tally(outcome);
+                return outcome;
+            }
+        };
+    }
+}
@@ -11,8 +11,11 @@ namespace hlt {
         long double vel_x = 0.000001, vel_y = 0.000001;
 
         void accelerate_by(double magnitude, double angle) {
-            vel_x = vel_x + magnitude * std::cos(angle);
-            vel_y = vel_y + magnitude * std::sin(angle);
+            double sin_angle, cos_angle;
+            fast_math::sincos(angle, sin_angle, cos_angle);
+
+            vel_x = vel_x + magnitude * cos_angle;
+            vel_y = vel_y + magnitude * sin_angle;
 
             const auto max_speed = constants::MAX_SPEED;
             if (this->magnitude() > max_speed) {
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+namespace hlt {
+    /**
+     * Polynomial replacements for the libm trig calls on our hot paths.
+     *
+     * fast_atan2 is within 1e-8 rad of std::atan2 (about 6e-7 degrees) and
+     * fast_sincos within 1e-13 of std::sin/std::cos, both far below the half
+     * degree it would take to change a rounded engine heading. Neither
+     * function branches on its input, so the *_n array versions vectorize.
+     */
+    namespace fast_math {
+        constexpr double TAN_PI_8 = 0.41421356237309504880;
+        constexpr double PIO2_HI = 1.57079632673412561417;
+        constexpr double PIO2_LO = 6.07710050650619224932e-11;
+
+        /// atan(t) for |t| <= tan(pi/8), Taylor series through t^17.
+        static inline double atan_reduced(const double t) {
+            const double t2 = t * t;
+            const double poly =
+                    1.0 + t2 * (-1.0 / 3 + t2 * (1.0 / 5 + t2 * (-1.0 / 7 + t2 * (1.0 / 9 +
+                    t2 * (-1.0 / 11 + t2 * (1.0 / 13 + t2 * (-1.0 / 15 + t2 * (1.0 / 17))))))));
+            return t * poly;
+        }
+
+        static inline double atan2(const double y, const double x) {
+            const double ax = std::fabs(x);
+            const double ay = std::fabs(y);
+            const bool swap = ay > ax;
+            const double num = swap ? ax : ay;
+            const double den = swap ? ay : ax;
+            const double z = den == 0.0 ? 0.0 : num / den;
+
+            // atan(z) = pi/4 + atan((z - 1) / (z + 1)) keeps the series argument small
+            const bool shift = z > TAN_PI_8;
+            const double t = shift ? (z - 1.0) / (z + 1.0) : z;
+            double angle = (shift ? M_PI_4 : 0.0) + atan_reduced(t);
+
+            angle = swap ? M_PI_2 - angle : angle;
+            angle = x < 0.0 ? M_PI - angle : angle;
+            return y < 0.0 ? -angle : angle;
+        }
+
+        static inline void sincos(const double angle, double& sin_out, double& cos_out) {
+            // reduce to [-pi/4, pi/4] and remember the quadrant
+            const double k = std::nearbyint(angle * M_2_PI);
+            const double r = (angle - k * PIO2_HI) - k * PIO2_LO;
+            const long quadrant = static_cast<long>(k) & 3;
+
+            const double r2 = r * r;
+            const double s = r * (1.0 + r2 * (-1.0 / 6 + r2 * (1.0 / 120 + r2 * (-1.0 / 5040 +
+                    r2 * (1.0 / 362880 + r2 * (-1.0 / 39916800 + r2 * (1.0 / 6227020800)))))));
+            const double c = 1.0 + r2 * (-1.0 / 2 + r2 * (1.0 / 24 + r2 * (-1.0 / 720 +
+                    r2 * (1.0 / 40320 + r2 * (-1.0 / 3628800 + r2 * (1.0 / 479001600 + r2 * (-1.0 / 87178291200)))))));
+
+            const bool odd = quadrant & 1;
+            const double sin_base = odd ? c : s;
+            const double cos_base = odd ? s : c;
+            sin_out = (quadrant & 2) ? -sin_base : sin_base;
+            cos_out = (quadrant == 1 || quadrant == 2) ? -cos_base : cos_base;
+        }
+
+        static inline double sin(const double angle) {
+            double s, c;
+            sincos(angle, s, c);
+            return s;
+        }
+
+        static inline double cos(const double angle) {
+            double s, c;
+            sincos(angle, s, c);
+            return c;
+        }
+
+        static void atan2_n(const double* ys, const double* xs, double* out, const std::size_t count) {
+            for (std::size_t i = 0; i < count; ++i) {
+                out[i] = atan2(ys[i], xs[i]);
+            }
+        }
+
+        static void sincos_n(const double* angles, double* sin_out, double* cos_out, const std::size_t count) {
+            for (std::size_t i = 0; i < count; ++i) {
+                sincos(angles[i], sin_out[i], cos_out[i]);
+            }
+        }
+    }
+}
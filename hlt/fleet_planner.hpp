@@ -0,0 +1,601 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
+
+#include "assignment.hpp"
+#include "collision.hpp"
+#include "docking_slots.hpp"
+#include "influence_map.hpp"
+#include "profiling.hpp"
+#include "region_partition.hpp"
+#include "ship_combat.hpp"
+#include "thread_pool.hpp"
+#include "turn_clock.hpp"
+
+namespace hlt {
+    namespace planning {
+        /// Everything deciding a ship's move needs besides the map.
+        struct TurnContext {
+            PlayerId player_id;
+            bool has_decided_to_abandon;
+            bool should_rush_at_the_start;
+            PlayerId rush_target;
+            /// Ships the rollout search already moved.
+            const std::unordered_set<EntityId>* searched_ships;
+            /// Set by plan_ship when it stopped at an enemy target the map it was given doesn't have.
+            bool needs_shared_map;
+        };
+
+        /**
+         * Decide one ship's move: abandon, rush, its assigned target, and
+         * failing that its targets nearest first. Returns whether the ship
+         * counts as having moved.
+         *
+         * On a region's map, which only has the ships near the region, it
+         * stops with needs_shared_map set at the first enemy target that
+         * isn't there, before trying it; our own ships are never targets.
+         * Likewise if the attacker the ship would stand up to isn't there.
+         */
+        static bool plan_ship(Map& map, TurnContext& context, std::vector<Move>& moves, Ship& ship) {
+            const PlayerId player_id = context.player_id;
+            bool has_made_move = context.searched_ships->count(ship.entity_id) > 0;
+            const auto is_on_map = [&](const NearbyEntity& entity) {
+                return !entity.is_ship || map.has_ship(entity.owner_id, entity.entity_id);
+            };
+
+            if (!has_made_move && context.has_decided_to_abandon) {
+                const profiling::ScopedTimer timer(profiling::Phase::Abandonment);
+                combat::handle_abandonment(map, moves, ship, 360);
+                has_made_move = true;
+            }
+
+            if (ship.priority_targets.empty()) {
+                // ship has no targets, its probably docked or everyone could be dead
+                return false;
+            }
+
+            if (!has_made_move && context.should_rush_at_the_start) {
+                const profiling::ScopedTimer timer(profiling::Phase::Rush);
+                combat::handle_rush(map, moves, context.rush_target, context.should_rush_at_the_start, ship);
+                has_made_move = true;
+            }
+
+            if (!has_made_move) {
+                // handle_ship looks this one up whatever the target
+                const combat::Threat* threat = combat::ThreatTable::get().defended_by(ship.entity_id);
+                if (threat != nullptr && !map.has_ship(threat->attacker_owner, threat->attacker_id)) {
+                    context.needs_shared_map = true;
+                    return false;
+                }
+
+                possibly<NearbyEntity> assigned = assignment::TargetAssignment::get().target_of(ship);
+                if (assigned.second && !is_on_map(assigned.first)) {
+                    context.needs_shared_map = true;
+                    return false;
+                }
+                if (assigned.second && combat::handle_ship(map, player_id, moves, ship, assigned.first)) {
+                    has_made_move = true;
+                }
+            }
+
+            // the assigned target turned us down, go back to nearest first
+            while (!has_made_move && !ship.priority_targets.empty()) {
+                auto entity = ship.priority_targets.top();
+                ship.priority_targets.pop();
+
+                if (!is_on_map(entity)) {
+                    if (entity.owner_id == player_id) {
+                        // handle_ship turns our own ships down anyway
+                        continue;
+                    }
+                    context.needs_shared_map = true;
+                    return false;
+                }
+                if (combat::handle_ship(map, player_id, moves, ship, entity)) {
+                    has_made_move = true;
+                    break;
+                }
+            }
+
+            docking::DockingSlots::get().release_stale_claim(ship);
+            return has_made_move;
+        }
+
+        /// Let the ships planned after this one see where it is going.
+        static void relocate_influence(const PlayerId player_id, const Ship& ship) {
+            if (ship.docking_status != ShipDockingStatus::Undocked) {
+                return;
+            }
+            const Location destination = {
+                ship.location.pos_x + (double) ship.velocity.vel_x,
+                ship.location.pos_y + (double) ship.velocity.vel_y };
+            combat::InfluenceMap::get().relocate(player_id, ship.location, destination);
+        }
+
+        struct PlanningReport {
+            unsigned int ships = 0;
+            /// Ships planned with full effort, with searches cut short, and left on their fallback move.
+            unsigned int full = 0;
+            unsigned int degraded = 0;
+            unsigned int fallback = 0;
+            /// Parallel planning only: proposals kept at the merge, and ships planned again.
+            unsigned int accepted = 0;
+            unsigned int replanned = 0;
+            /// Regions the fleet was split into, or 0 if ships were proposed one by one.
+            unsigned int regions = 0;
+            double propose_ms = 0;
+            double merge_ms = 0;
+        };
+
+        /// Fleet indices, ships with an enemy within TURN_PRIORITY_RADIUS first, each part in fleet order.
+        static std::vector<size_t> planning_order(const Map& map, const PlayerId player_id) {
+            const std::vector<Ship>& fleet = map.ships.at(player_id);
+            std::vector<size_t> order(fleet.size());
+            for (size_t i = 0; i < fleet.size(); ++i) {
+                order[i] = i;
+            }
+
+            std::stable_partition(order.begin(), order.end(), [&](const size_t i) {
+                for (const NearbyEntity& enemy : fleet[i].nearby_enemy_ships) {
+                    if (enemy.distance <= constants::TURN_PRIORITY_RADIUS) {
+                        return true;
+                    }
+                }
+                return false;
+            });
+            return order;
+        }
+
+        /**
+         * A move for when there is no time left to plan a ship: dock if a
+         * planet with room is in reach, otherwise stay put. Either way the
+         * ship doesn't move, which is what everyone planned before it
+         * assumed.
+         */
+        static possibly<Move> fallback_move(const Map& map, const PlayerId player_id, const Ship& ship) {
+            if (ship.docking_status != ShipDockingStatus::Undocked) {
+                return { Move::noop(), false };
+            }
+            for (const Planet& planet : map.planets) {
+                if ((!planet.is_owned || planet.owner_id == player_id) && !planet.is_full() && ship.can_dock(planet)) {
+                    return { Move::dock(ship.entity_id, planet.entity_id), true };
+                }
+            }
+            return { Move::noop(), false };
+        }
+
+        /// Fallback moves for the whole fleet, by fleet index, worked out before any real planning.
+        static std::vector<possibly<Move>> fallback_moves(const Map& map, const PlayerId player_id) {
+            std::vector<possibly<Move>> fallbacks;
+            for (const Ship& ship : map.ships.at(player_id)) {
+                fallbacks.push_back(fallback_move(map, player_id, ship));
+            }
+            return fallbacks;
+        }
+
+        static void use_fallback(const possibly<Move>& fallback, std::vector<Move>& moves, PlanningReport& report) {
+            if (fallback.second) {
+                moves.push_back(fallback.first);
+            }
+            report.fallback++;
+        }
+
+        /**
+         * Plan every ship in priority order, each one seeing the moves of those
+         * before it, until the turn clock runs out; the rest keep their
+         * fallback move.
+         */
+        static void plan_fleet_serial(Map& map, TurnContext& context, std::vector<Move>& moves, PlanningReport& report) {
+            const timing::TurnClock& turn_clock = timing::TurnClock::get();
+            const std::vector<possibly<Move>> fallbacks = fallback_moves(map, context.player_id);
+            std::vector<Ship>& fleet = map.ships.at(context.player_id);
+            report = PlanningReport();
+            report.ships = fleet.size();
+
+            for (const size_t i : planning_order(map, context.player_id)) {
+                if (turn_clock.is_out_of_time()) {
+                    use_fallback(fallbacks[i], moves, report);
+                    continue;
+                }
+
+                const bool is_degraded = turn_clock.effort() < 1;
+                if (plan_ship(map, context, moves, fleet[i])) {
+                    relocate_influence(context.player_id, fleet[i]);
+                }
+                is_degraded ? report.degraded++ : report.full++;
+            }
+        }
+
+        /// What a worker decided for one ship, against the frame as it was at the start of planning.
+        struct Proposal {
+            /// The turn clock ran out before the ship came up.
+            bool skipped;
+            bool is_degraded;
+            bool has_made_move;
+            /// The rush flag the proposal was made under, and whether planning cleared it.
+            bool planned_rush;
+            bool cleared_rush;
+            /// The ship went for something outside its region's halo, so only the whole map will do.
+            bool needs_shared_map;
+
+            std::vector<Move> moves;
+            vel velocity;
+            bool needs_local_avoidance;
+            Location avoidance_target;
+            possibly<docking::DockingSlots::Claim> claim;
+        };
+
+        /// How much work one region was.
+        struct RegionLoad {
+            unsigned int ships = 0;
+            /// Ships of every player on the region's map.
+            unsigned int local_ships = 0;
+            /// Ships left for the merge to plan on the whole map.
+            unsigned int deferred = 0;
+            double ms = 0;
+        };
+
+        /**
+         * Plans the fleet on the thread pool in two steps.
+         *
+         * Every ship is a task. Each thread takes a private copy of the map
+         * and the docking slots, and proposes moves against the frame as it
+         * stood before anyone moved. After each ship it puts back the ship's
+         * velocity and avoidance state and the slots it claimed or released;
+         * the targets it popped are its own and are never looked at again.
+         * So a proposal depends on nothing but the frame, not on which
+         * thread ran it.
+         *
+         * The merge then walks the fleet in priority order like the serial loop does.
+         * It keeps a proposal if it still holds up given the ships already
+         * merged: its docking slot is still free and its heading doesn't run
+         * into anyone. Otherwise it plans that ship again on the shared map.
+         * The result is the same for any number of threads.
+         *
+         * Once there are REGION_PLANNING_MIN_SHIPS ships on the map, proposals
+         * are made a region at a time instead. Each region is one task that
+         * plans its ships in turn against a map of only the ships within its
+         * halo, and the merge sorts out the borders the same way.
+         */
+        class ParallelPlanner {
+        private:
+            /// Scratch for one thread; the map and slots are copied once per proposal step, on first use.
+            struct Worker {
+                std::unique_ptr<Map> map;
+                unsigned int generation = 0;
+                docking::DockingSlots slots;
+            };
+
+            /// Scratch for one region, kept from turn to turn.
+            struct RegionScratch {
+                std::unique_ptr<Map> map;
+                docking::DockingSlots slots;
+            };
+
+            ThreadPool& pool;
+            std::vector<Worker> workers;
+            std::vector<Proposal> proposals;
+            unsigned int generation = 0;
+
+            std::vector<RegionScratch> region_scratch;
+            std::vector<RegionLoad> region_loads;
+
+            static bool still_holds(Map& map, Ship& ship, const Proposal& proposal) {
+                if (proposal.claim.second) {
+                    const docking::DockingSlots& slots = docking::DockingSlots::get();
+                    const Planet& planet = map.get_planet(proposal.claim.first.planet_id);
+                    if (slots.is_full(planet, ship)) {
+                        return false;
+                    }
+                    const possibly<Location> slot = slots.peek(planet, ship);
+                    if (!slot.second || !(slot.first == proposal.claim.first.location)) {
+                        return false;
+                    }
+                }
+
+                if (proposal.needs_local_avoidance) {
+                    // local avoidance settles these against everyone after planning
+                    return true;
+                }
+
+                for (const Move& move : proposal.moves) {
+                    if (move.type != MoveType::Thrust) {
+                        continue;
+                    }
+
+                    const vel before = ship.velocity;
+                    ship.velocity = proposal.velocity;
+                    const Location destination = {
+                        ship.location.pos_x + (double) ship.velocity.vel_x,
+                        ship.location.pos_y + (double) ship.velocity.vel_y };
+                    const bool collides = collision::will_collide(map, ship, destination);
+                    ship.velocity = before;
+                    if (collides) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            /// Propose a move for every ship, one task per ship, on whichever pool is given.
+            void propose(const Map& map, const TurnContext& context, ThreadPool& on) {
+                const docking::DockingSlots& shared_slots = docking::DockingSlots::get();
+                const timing::TurnClock& turn_clock = timing::TurnClock::get();
+                const std::vector<Ship>& fleet = map.ships.at(context.player_id);
+                proposals.assign(fleet.size(), Proposal());
+                generation++;
+
+                TaskGroup ships;
+                for (size_t i = 0; i < fleet.size(); ++i) {
+                    on.run(ships, [&, i] {
+                        Worker& worker = workers[on.worker_index()];
+                        if (worker.generation != generation) {
+                            if (worker.map) {
+                                *worker.map = map;
+                            } else {
+                                worker.map.reset(new Map(map));
+                            }
+                            worker.slots = shared_slots;
+                            worker.slots.record_changes();
+                            worker.generation = generation;
+                        }
+
+                        Proposal& proposal = proposals[i];
+                        proposal.skipped = turn_clock.is_out_of_time();
+                        if (proposal.skipped) {
+                            return;
+                        }
+                        proposal.is_degraded = turn_clock.effort() < 1;
+
+                        docking::DockingSlots::install_for_this_thread(&worker.slots);
+
+                        Ship& ship = worker.map->ships.at(context.player_id)[i];
+                        const vel velocity = ship.velocity;
+                        const bool needs_local_avoidance = ship.needs_local_avoidance;
+                        const Location avoidance_target = ship.avoidance_target;
+
+                        TurnContext local_context = context;
+                        proposal.planned_rush = context.should_rush_at_the_start;
+                        proposal.has_made_move = plan_ship(*worker.map, local_context, proposal.moves, ship);
+                        proposal.cleared_rush = context.should_rush_at_the_start && !local_context.should_rush_at_the_start;
+                        proposal.velocity = ship.velocity;
+                        proposal.needs_local_avoidance = ship.needs_local_avoidance;
+                        proposal.avoidance_target = ship.avoidance_target;
+                        proposal.claim = worker.slots.claim_of(ship);
+
+                        // leave the copy as the frame was for the next ship
+                        ship.velocity = velocity;
+                        ship.needs_local_avoidance = needs_local_avoidance;
+                        ship.avoidance_target = avoidance_target;
+                        worker.slots.undo_changes();
+                        docking::DockingSlots::install_for_this_thread(nullptr);
+                    });
+                }
+                on.wait(ships);
+            }
+
+            /**
+             * Propose a move for every ship, one task per region. Within a region
+             * ships are planned in priority order, each seeing the moves of the
+             * ones before it, like the serial loop on a smaller map.
+             */
+            void propose_by_region(const Map& map, const TurnContext& context, const std::vector<size_t>& order) {
+                typedef std::chrono::steady_clock clock;
+                const docking::DockingSlots& shared_slots = docking::DockingSlots::get();
+                const timing::TurnClock& turn_clock = timing::TurnClock::get();
+                const std::vector<Ship>& fleet = map.ships.at(context.player_id);
+                proposals.assign(fleet.size(), Proposal());
+
+                std::vector<Region> regions = partition_fleet(map, context.player_id);
+                std::vector<size_t> rank(fleet.size());
+                for (size_t r = 0; r < order.size(); ++r) {
+                    rank[order[r]] = r;
+                }
+                for (Region& region : regions) {
+                    std::sort(region.ships.begin(), region.ships.end(), [&](const size_t a, const size_t b) {
+                        return rank[a] < rank[b];
+                    });
+                }
+
+                if (region_scratch.size() < regions.size()) {
+                    region_scratch.resize(regions.size());
+                }
+                region_loads.assign(regions.size(), RegionLoad());
+
+                TaskGroup tasks;
+                for (size_t r = 0; r < regions.size(); ++r) {
+                    pool.run(tasks, [&, r] {
+                        const clock::time_point start = clock::now();
+                        const Region& region = regions[r];
+                        RegionScratch& scratch = region_scratch[r];
+                        RegionLoad& load = region_loads[r];
+                        if (!scratch.map) {
+                            scratch.map.reset(new Map(map.map_width, map.map_height));
+                        }
+                        Map& local = *scratch.map;
+                        load.ships = region.ships.size();
+                        load.local_ships = build_local_map(map, region, local);
+
+                        scratch.slots = shared_slots;
+                        docking::DockingSlots::install_for_this_thread(&scratch.slots);
+                        TurnContext local_context = context;
+
+                        for (const size_t i : region.ships) {
+                            Proposal& proposal = proposals[i];
+                            proposal.skipped = turn_clock.is_out_of_time();
+                            if (proposal.skipped) {
+                                continue;
+                            }
+                            proposal.is_degraded = turn_clock.effort() < 1;
+
+                            Ship& ship = local.get_ship(context.player_id, fleet[i].entity_id);
+                            const vel velocity = ship.velocity;
+                            const bool needs_local_avoidance = ship.needs_local_avoidance;
+                            const Location avoidance_target = ship.avoidance_target;
+                            proposal.planned_rush = local_context.should_rush_at_the_start;
+                            local_context.needs_shared_map = false;
+                            proposal.has_made_move = plan_ship(local, local_context, proposal.moves, ship);
+                            if (local_context.needs_shared_map) {
+                                // it only tried targets that turned it down, which leave nothing behind
+                                // but the heading they tried; the merge plans it on the whole map
+                                proposal.needs_shared_map = true;
+                                proposal.moves.clear();
+                                ship.velocity = velocity;
+                                ship.needs_local_avoidance = needs_local_avoidance;
+                                ship.avoidance_target = avoidance_target;
+                                load.deferred++;
+                                continue;
+                            }
+                            proposal.cleared_rush = proposal.planned_rush && !local_context.should_rush_at_the_start;
+                            proposal.velocity = ship.velocity;
+                            proposal.needs_local_avoidance = ship.needs_local_avoidance;
+                            proposal.avoidance_target = ship.avoidance_target;
+                            proposal.claim = scratch.slots.claim_of(ship);
+                        }
+
+                        docking::DockingSlots::install_for_this_thread(nullptr);
+                        load.ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+                    });
+                }
+                pool.wait(tasks);
+            }
+
+            bool should_use_regions(const Map& map, const TurnContext& context) const {
+                if (!constants::ENABLE_REGION_PLANNING || context.should_rush_at_the_start) {
+                    // rushing looks up the target's whole fleet
+                    return false;
+                }
+                unsigned int ships = 0;
+                for (const auto& player_ships : map.ships) {
+                    ships += player_ships.second.size();
+                }
+                return ships >= constants::REGION_PLANNING_MIN_SHIPS;
+            }
+
+        public:
+            explicit ParallelPlanner(ThreadPool& thread_pool) : pool(thread_pool), workers(thread_pool.size()) {
+            }
+
+            void plan_fleet(Map& map, TurnContext& context, std::vector<Move>& moves, PlanningReport& report) {
+                typedef std::chrono::steady_clock clock;
+                report = PlanningReport();
+
+                const std::vector<size_t> order = planning_order(map, context.player_id);
+                const clock::time_point start = clock::now();
+                region_loads.clear();
+                if (should_use_regions(map, context)) {
+                    propose_by_region(map, context, order);
+                    report.regions = region_loads.size();
+                } else {
+                    propose(map, context, pool);
+                }
+                const clock::time_point proposed = clock::now();
+
+                const timing::TurnClock& turn_clock = timing::TurnClock::get();
+                const std::vector<possibly<Move>> fallbacks = fallback_moves(map, context.player_id);
+                std::vector<Ship>& fleet = map.ships.at(context.player_id);
+                report.ships = fleet.size();
+                for (const size_t i : order) {
+                    Ship& ship = fleet[i];
+                    const Proposal& proposal = proposals[i];
+
+                    bool has_made_move;
+                    if (proposal.skipped) {
+                        use_fallback(fallbacks[i], moves, report);
+                        continue;
+                    } else if (!proposal.needs_shared_map && proposal.planned_rush == context.should_rush_at_the_start &&
+                               still_holds(map, ship, proposal)) {
+                        moves.insert(moves.end(), proposal.moves.begin(), proposal.moves.end());
+                        ship.velocity = proposal.velocity;
+                        ship.needs_local_avoidance = proposal.needs_local_avoidance;
+                        ship.avoidance_target = proposal.avoidance_target;
+                        if (proposal.claim.second) {
+                            docking::DockingSlots::get().reserve(map.get_planet(proposal.claim.first.planet_id), ship);
+                        }
+                        docking::DockingSlots::get().release_stale_claim(ship);
+                        if (proposal.cleared_rush) {
+                            context.should_rush_at_the_start = false;
+                        }
+                        has_made_move = proposal.has_made_move;
+                        proposal.is_degraded ? report.degraded++ : report.full++;
+                        report.accepted++;
+                    } else if (turn_clock.is_out_of_time()) {
+                        use_fallback(fallbacks[i], moves, report);
+                        continue;
+                    } else {
+                        const bool is_degraded = turn_clock.effort() < 1;
+                        has_made_move = plan_ship(map, context, moves, ship);
+                        is_degraded ? report.degraded++ : report.full++;
+                        report.replanned++;
+                    }
+
+                    if (has_made_move) {
+                        relocate_influence(context.player_id, ship);
+                    }
+                }
+
+                report.propose_ms = std::chrono::duration<double, std::milli>(proposed - start).count();
+                report.merge_ms = std::chrono::duration<double, std::milli>(clock::now() - proposed).count();
+            }
+
+            /// Per-region work of the last plan_fleet, empty if it didn't split the fleet.
+            const std::vector<RegionLoad>& last_region_loads() const {
+                return region_loads;
+            }
+
+            /**
+             * Time the proposal step on pools of 1 to N threads over the current frame and
+             * log the speedup of each over one thread. Proposals don't depend
+             * on the thread count, so any that differ from the one thread run
+             * are counted as well.
+             */
+            void report_speedup(const Map& map, const TurnContext& context) {
+                typedef std::chrono::steady_clock clock;
+                std::vector<Proposal> baseline;
+                double baseline_ms = 0;
+
+                // one untimed pass first, so every timed pass finds the navigation cache and flow fields the same
+                propose(map, context, pool);
+
+                std::ostringstream log;
+                log << "parallel planning speedup over " << map.ships.at(context.player_id).size() << " ships:";
+                for (unsigned int threads = 1; threads <= pool.size(); ++threads) {
+                    ThreadPool limited(threads);
+                    const clock::time_point start = clock::now();
+                    propose(map, context, limited);
+                    const double elapsed_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+                    unsigned int mismatches = 0;
+                    if (threads == 1) {
+                        baseline = proposals;
+                        baseline_ms = elapsed_ms;
+                    } else {
+                        for (size_t i = 0; i < proposals.size(); ++i) {
+                            const std::vector<Move>& a = baseline[i].moves;
+                            const std::vector<Move>& b = proposals[i].moves;
+                            bool same = a.size() == b.size();
+                            for (size_t m = 0; same && m < a.size(); ++m) {
+                                same = a[m].type == b[m].type && a[m].move_thrust == b[m].move_thrust &&
+                                    a[m].move_angle_deg == b[m].move_angle_deg && a[m].dock_to == b[m].dock_to;
+                            }
+                            mismatches += !same;
+                        }
+                    }
+
+                    log << " " << threads << " threads " << elapsed_ms << "ms ("
+                        << (elapsed_ms > 0 ? baseline_ms / elapsed_ms : 0) << "x";
+                    if (mismatches > 0) {
+                        log << ", " << mismatches << " ships differ";
+                    }
+                    log << ");";
+                }
+                Log::log(log.str());
+            }
+        };
+    }
+}
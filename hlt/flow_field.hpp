@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+#include "map.hpp"
+
+namespace hlt {
+    namespace navigation {
+        /**
+         * A coarse grid over the map where every cell points at its neighbour
+         * that is one step closer to a goal, routing around planets.
+         *
+         * Built once per goal per turn, after which any number of ships can
+         * read their heading without running their own search.
+         */
+        class FlowField {
+        private:
+            int cols = 0;
+            int rows = 0;
+            std::vector<int> next_cell;
+            std::vector<float> cost;
+            std::vector<bool> blocked;
+
+            int cell_of(const Location& location) const {
+                const double cell = constants::FLOW_FIELD_CELL;
+                const int col = std::max(0, std::min(cols - 1, static_cast<int>(location.pos_x / cell)));
+                const int row = std::max(0, std::min(rows - 1, static_cast<int>(location.pos_y / cell)));
+                return row * cols + col;
+            }
+
+            Location center_of(const int index) const {
+                const double cell = constants::FLOW_FIELD_CELL;
+                return { (index % cols + 0.5) * cell, (index / cols + 0.5) * cell };
+            }
+
+        public:
+            bool is_built = false;
+
+            /**
+             * Run a Dijkstra search outwards from every cell within goal_radius
+             * of goal. Cells covered by a planet (other than the goal) are
+             * never entered.
+             */
+            void build(const Map& map, const Location& goal, const double goal_radius) {
+                const double cell = constants::FLOW_FIELD_CELL;
+                cols = static_cast<int>(std::ceil(map.map_width / cell));
+                rows = static_cast<int>(std::ceil(map.map_height / cell));
+                const int size = cols * rows;
+
+                next_cell.assign(size, -1);
+                cost.assign(size, std::numeric_limits<float>::max());
+                blocked.assign(size, false);
+
+                typedef std::pair<float, int> Node;
+                std::priority_queue<Node, std::vector<Node>, std::greater<Node>> open;
+
+                for (int i = 0; i < size; ++i) {
+                    const Location center = center_of(i);
+                    for (const Planet& planet : map.planets) {
+                        const double clearance = planet.radius + constants::SHIP_RADIUS + constants::FLOW_FIELD_PLANET_MARGIN;
+                        if (center.get_distance_to(planet.location) <= clearance && !(planet.location == goal)) {
+                            blocked[i] = true;
+                            break;
+                        }
+                    }
+
+                    if (!blocked[i] && center.get_distance_to(goal) <= goal_radius) {
+                        cost[i] = 0;
+                        open.push({ 0.0f, i });
+                    }
+                }
+
+                static const int dcol[] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+                static const int drow[] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+                static const float step[] = { 1, 1, 1, 1, M_SQRT2, M_SQRT2, M_SQRT2, M_SQRT2 };
+
+                while (!open.empty()) {
+                    const Node node = open.top();
+                    open.pop();
+                    if (node.first > cost[node.second]) {
+                        continue;
+                    }
+
+                    const int col = node.second % cols;
+                    const int row = node.second / cols;
+                    for (int d = 0; d < 8; ++d) {
+                        const int ncol = col + dcol[d];
+                        const int nrow = row + drow[d];
+                        if (ncol < 0 || nrow < 0 || ncol >= cols || nrow >= rows) {
+                            continue;
+                        }
+
+                        const int neighbour = nrow * cols + ncol;
+                        // diagonal moves may not cut the corner of a planet
+                        if (blocked[neighbour] || blocked[row * cols + ncol] || blocked[nrow * cols + col]) {
+                            continue;
+                        }
+
+                        const float new_cost = node.first + step[d];
+                        if (new_cost < cost[neighbour]) {
+                            cost[neighbour] = new_cost;
+                            next_cell[neighbour] = node.second;
+                            open.push({ new_cost, neighbour });
+                        }
+                    }
+                }
+
+                is_built = true;
+            }
+
+            /**
+             * Follow the field from the given location for a few cells and
+             * return where we end up, which is the point a ship should steer at.
+             */
+            possibly<Location> waypoint(const Location& from) const {
+                int index = cell_of(from);
+                if (cost[index] == std::numeric_limits<float>::max()) {
+                    return { from, false };
+                }
+
+                for (int i = 0; i < constants::FLOW_FIELD_LOOKAHEAD && next_cell[index] != -1; ++i) {
+                    index = next_cell[index];
+                }
+
+                return { center_of(index), true };
+            }
+        };
+
+        /// The flow fields requested this turn, keyed by the planet they lead to.
+        class FlowFieldCache {
+        private:
+            entity_map<FlowField> fields;
+            /// Fields are built lazily, possibly from several planning threads at once.
+            std::mutex mutex;
+
+            FlowField& field_for(const Map& map, const EntityId planet_id, const Location& goal, const double goal_radius) {
+                std::lock_guard<std::mutex> lock(mutex);
+                FlowField& field = fields[planet_id];
+                if (!field.is_built) {
+                    field.build(map, goal, goal_radius);
+                    fields_built++;
+                }
+                return field;
+            }
+
+        public:
+            unsigned int fields_built = 0;
+
+            static FlowFieldCache& get() {
+                static FlowFieldCache instance{};
+                return instance;
+            }
+
+            /// Mark every field stale; they are rebuilt on first use. Fields nobody asked
+            /// for last turn are dropped, the others keep their allocations.
+            void begin_turn() {
+                fields_built = 0;
+                for (auto it = fields.begin(); it != fields.end();) {
+                    if (!it->second.is_built) {
+                        it = fields.erase(it);
+                    } else {
+                        it->second.is_built = false;
+                        ++it;
+                    }
+                }
+            }
+
+            /**
+             * Copy in every field prepared has built for a goal not built yet
+             * this turn. prepared must have been built against this turn's planets.
+             */
+            unsigned int adopt(const FlowFieldCache& prepared) {
+                std::lock_guard<std::mutex> lock(mutex);
+                unsigned int adopted = 0;
+                for (const auto& entry : prepared.fields) {
+                    if (!entry.second.is_built) {
+                        continue;
+                    }
+                    FlowField& field = fields[entry.first];
+                    if (!field.is_built) {
+                        field = entry.second;
+                        adopted++;
+                    }
+                }
+                return adopted;
+            }
+
+            /// Field leading into the docking ring of a planet.
+            const FlowField& towards_planet(const Map& map, const Entity& planet) {
+                return field_for(map, planet.entity_id, planet.location, planet.radius + constants::DOCK_RADIUS);
+            }
+        };
+    }
+}
@@ -2,9 +2,11 @@
 
 #include <iostream>
 
+#include "allocation_tracker.hpp"
 #include "log.hpp"
 #include "hlt_in.hpp"
 #include "hlt_out.hpp"
+#include "profiling.hpp"
 
 namespace hlt {
     struct Metadata {
@@ -26,6 +28,12 @@ namespace hlt {
         iss2 >> map_width >> map_height;
 
         Log::open(std::to_string(player_id) + "_" + bot_name + ".log");
+        if (constants::ENABLE_PROFILING) {
+            profiling::Profiler::get().open(std::to_string(player_id) + "_" + bot_name);
+        }
+        if (constants::ENABLE_ALLOCATION_TRACKING) {
+            memory::AllocationTracker::get().open(std::to_string(player_id) + "_" + bot_name);
+        }
 
         in::setup(bot_name, map_width, map_height);
 
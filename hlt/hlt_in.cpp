@@ -1,6 +1,9 @@
 #include "hlt_in.hpp"
+#include "allocation_tracker.hpp"
 #include "log.hpp"
 #include "hlt_out.hpp"
+#include "profiling.hpp"
+#include "turn_clock.hpp"
 
 namespace hlt {
     namespace in {
@@ -21,6 +24,7 @@ namespace hlt {
             }
 
             const std::string input = get_string();
+            timing::TurnClock::get().start();
 
             if (!std::cin.good()) {
                 // This is needed on Windows to detect that game engine is done.
@@ -32,8 +36,15 @@ namespace hlt {
             } else {
                 Log::log("--- TURN " + std::to_string(g_turn) + " ---");
             }
+            if (constants::ENABLE_PROFILING) {
+                profiling::Profiler::get().begin_turn(g_turn);
+            }
+            if (constants::ENABLE_ALLOCATION_TRACKING) {
+                memory::AllocationTracker::get().begin_turn(g_turn);
+            }
             ++g_turn;
 
+            const profiling::ScopedTimer timer(profiling::Phase::Parse);
             return parse_map(input, g_map_width, g_map_height);
         }
     }
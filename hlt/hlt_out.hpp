@@ -5,6 +5,7 @@
 
 #include "log.hpp"
 #include "move.hpp"
+#include "profiling.hpp"
 
 namespace hlt {
     namespace out {
@@ -16,6 +17,8 @@ namespace hlt {
 
         /// Send all queued moves to the game engine.
         static bool send_moves(const std::vector<Move>& moves) {
+            const profiling::ScopedTimer timer(profiling::Phase::SendMoves);
+
             std::ostringstream oss;
             for (const Move& move : moves) {
                 switch (move.type) {
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "map.hpp"
+#include "collision.hpp"
+
+namespace hlt {
+    namespace combat {
+        /**
+         * Per-turn grid over the map counting, at every grid point, how many
+         * undocked enemy ships could reach weapon range of it next turn and
+         * how many of our own undocked ships could.
+         *
+         * Built in one pass over the ships, after which the danger of any point
+         * is a bilinear lookup instead of a loop over every ship.
+         */
+        class InfluenceMap {
+        private:
+            int cols = 0;
+            int rows = 0;
+            PlayerId player_id = -1;
+            std::vector<float> enemy_threat;
+            std::vector<float> friendly_support;
+
+            static double reach() {
+                return constants::MAX_SPEED + 2 * constants::SHIP_RADIUS + constants::WEAPON_RADIUS;
+            }
+
+            void row_range(const Location& location, int& row_min, int& row_max) const {
+                const double cell = constants::INFLUENCE_MAP_CELL;
+                row_min = std::max(0, (int) std::ceil((location.pos_y - reach()) / cell));
+                row_max = std::min(rows - 1, (int) std::floor((location.pos_y + reach()) / cell));
+            }
+
+            /**
+             * First and last column on row within reach of location; first > last
+             * if there are none. The columns in reach are always one run, so the
+             * square root only gives a first guess, which is then nudged until
+             * it agrees with the exact distance test at both ends.
+             */
+            void row_span(const Location& location, const int row, int& first, int& last) const {
+                const double cell = constants::INFLUENCE_MAP_CELL;
+                const double radius = reach();
+                const double dy = row * cell - location.pos_y;
+                const double room = radius * radius - dy * dy;
+                const auto in_reach = [&](const int col) {
+                    const double dx = col * cell - location.pos_x;
+                    return dx * dx + dy * dy <= radius * radius;
+                };
+
+                const int col_min = std::max(0, (int) std::ceil((location.pos_x - radius) / cell));
+                const int col_max = std::min(cols - 1, (int) std::floor((location.pos_x + radius) / cell));
+                const double half = std::sqrt(std::max(0.0, room));
+                first = std::max(col_min, std::min(col_max, (int) std::ceil((location.pos_x - half) / cell)));
+                last = std::max(col_min, std::min(col_max, (int) std::floor((location.pos_x + half) / cell)));
+
+                while (first > col_min && in_reach(first - 1)) {
+                    first--;
+                }
+                while (first <= col_max && !in_reach(first)) {
+                    first++;
+                }
+                while (last < col_max && in_reach(last + 1)) {
+                    last++;
+                }
+                while (last >= first && !in_reach(last)) {
+                    last--;
+                }
+            }
+
+            void stamp(std::vector<float>& grid, const Location& location, const float amount) {
+                int row_min, row_max;
+                row_range(location, row_min, row_max);
+
+                for (int row = row_min; row <= row_max; ++row) {
+                    int first, last;
+                    row_span(location, row, first, last);
+                    float* cells = &grid[row * cols];
+                    for (int col = first; col <= last; ++col) {
+                        cells[col] += amount;
+                    }
+                }
+            }
+
+            double sample(const std::vector<float>& grid, const Location& location) const {
+                const double cell = constants::INFLUENCE_MAP_CELL;
+                const double x = std::max(0.0, std::min(location.pos_x / cell, cols - 1.0));
+                const double y = std::max(0.0, std::min(location.pos_y / cell, rows - 1.0));
+                const int col = std::min((int) x, cols - 2);
+                const int row = std::min((int) y, rows - 2);
+                const double fx = x - col;
+                const double fy = y - row;
+
+                const float* top = &grid[row * cols + col];
+                const float* bottom = top + cols;
+                return (1 - fy) * ((1 - fx) * top[0] + fx * top[1]) +
+                        fy * ((1 - fx) * bottom[0] + fx * bottom[1]);
+            }
+
+        public:
+            bool is_built = false;
+
+            static InfluenceMap& get() {
+                static InfluenceMap instance{};
+                return instance;
+            }
+
+            /// Where a ship's influence is centred: enemies carry their predicted velocity, ours haven't moved yet.
+            static Location stamp_point(const Ship& ship) {
+                return { ship.location.pos_x + (double) ship.velocity.vel_x, ship.location.pos_y + (double) ship.velocity.vel_y };
+            }
+
+            /// Clear the grids for an empty map.
+            void reset(const int map_width, const int map_height, const PlayerId for_player) {
+                const double cell = constants::INFLUENCE_MAP_CELL;
+                player_id = for_player;
+                cols = (int) std::floor(map_width / cell) + 1;
+                rows = (int) std::floor(map_height / cell) + 1;
+                enemy_threat.assign(cols * rows, 0.0f);
+                friendly_support.assign(cols * rows, 0.0f);
+                is_built = true;
+            }
+
+            void build(const Map& map, const PlayerId for_player) {
+                reset(map.map_width, map.map_height, for_player);
+
+                for (const auto& player_ship : map.ships) {
+                    for (const Ship& ship : player_ship.second) {
+                        if (ship.docking_status == ShipDockingStatus::Undocked) {
+                            add(player_ship.first, stamp_point(ship), 1.0f);
+                        }
+                    }
+                }
+            }
+
+            /// Add a ship's influence at location, or take it away for a negative amount.
+            void add(const PlayerId owner, const Location& location, const float amount) {
+                stamp(owner == player_id ? friendly_support : enemy_threat, location, amount);
+            }
+
+            /// Whether a ship at a adds to exactly the same grid points as one at b.
+            bool same_footprint(const Location& a, const Location& b) const {
+                int a_min, a_max, b_min, b_max;
+                row_range(a, a_min, a_max);
+                row_range(b, b_min, b_max);
+                if (a_min != b_min || a_max != b_max) {
+                    return false;
+                }
+
+                for (int row = a_min; row <= a_max; ++row) {
+                    int a_first, a_last, b_first, b_last;
+                    row_span(a, row, a_first, a_last);
+                    row_span(b, row, b_first, b_last);
+                    // empty spans match whatever their ends
+                    if ((a_first <= a_last || b_first <= b_last) && (a_first != b_first || a_last != b_last)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            /**
+             * Move a ship's influence from where it is to where it is going,
+             * so later lookups this turn see the moves planned so far.
+             */
+            void relocate(const PlayerId owner, const Location& from, const Location& to) {
+                add(owner, from, -1.0f);
+                add(owner, to, 1.0f);
+            }
+
+            /// Roughly the number of enemy ships that could attack target next turn.
+            double danger_at(const Map& map, const Location& target) const {
+                if (collision::out_of_bounds(map, target)) {
+                    return 9999;
+                }
+                return sample(enemy_threat, target);
+            }
+
+            /// Roughly the number of our ships that could support target next turn.
+            double support_at(const Location& target) const {
+                return sample(friendly_support, target);
+            }
+        };
+    }
+}
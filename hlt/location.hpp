@@ -3,6 +3,7 @@
 #include <ostream>
 
 #include "constants.hpp"
+#include "fast_math.hpp"
 #include "util.hpp"
 
 namespace hlt {
@@ -32,15 +33,18 @@ namespace hlt {
             const double dx = target.pos_x - pos_x;
             const double dy = target.pos_y - pos_y;
 
-            return std::atan2(dy, dx) + 2 * M_PI;
+            return fast_math::atan2(dy, dx) + 2 * M_PI;
         }
 
         Location get_closest_point(const Location& target, const double target_radius) const {
             const double radius = target_radius;
             const double angle_rad = target.orient_towards_in_rad(*this);
 
-            const double x = target.pos_x + radius * std::cos(angle_rad);
-            const double y = target.pos_y + radius * std::sin(angle_rad);
+            double sin_angle, cos_angle;
+            fast_math::sincos(angle_rad, sin_angle, cos_angle);
+
+            const double x = target.pos_x + radius * cos_angle;
+            const double y = target.pos_y + radius * sin_angle;
 
             return { x, y };
         }
@@ -2,12 +2,14 @@
 
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
 
 namespace hlt {
     struct Log {
     private:
         std::ofstream file;
+        std::mutex mutex;
 
         void initialize(const std::string& filename) {
             file.open(filename, std::ios::trunc | std::ios::out);
@@ -24,7 +26,9 @@ namespace hlt {
         }
 
         static void log(const std::string& message) {
-            get().file << message << std::endl;
+            Log& log = get();
+            std::lock_guard<std::mutex> lock(log.mutex);
+            log.file << message << std::endl;
         }
     };
 }
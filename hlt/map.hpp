@@ -22,26 +22,13 @@ namespace hlt {
             return ships.at(player_id).at(ship_map.at(player_id).at(ship_id));
         }
 
-        Planet& get_planet(const EntityId planet_id) {
-            return planets.at(planet_map.at(planet_id));
-        }
-
-        void add_moving_towards (Planet& planet, Ship& ship) {
-            NearbyEntity ship_entity;
-            ship_entity.is_ship = true;
-            ship_entity.entity_id = ship.entity_id;
-            ship_entity.owner_id = ship.owner_id;
-            
-            planet.ships_moving_towards.push_back(ship_entity);
+        bool has_ship(const PlayerId player_id, const EntityId ship_id) const {
+            const auto owned = ship_map.find(player_id);
+            return owned != ship_map.end() && owned->second.count(ship_id) > 0;
         }
 
-        void add_moving_towards (Ship& end_ship, Ship& start_ship) {
-            NearbyEntity ship_entity;
-            ship_entity.is_ship = true;
-            ship_entity.entity_id = end_ship.entity_id;
-            ship_entity.owner_id = end_ship.owner_id;
-
-            start_ship.ships_moving_towards.push_back(ship_entity);
+        Planet& get_planet(const EntityId planet_id) {
+            return planets.at(planet_map.at(planet_id));
         }
     };
 }
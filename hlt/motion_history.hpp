@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <unordered_map>
+
+#include "map.hpp"
+
+namespace hlt {
+    namespace motion {
+        /// The last few positions of one ship, oldest overwritten first.
+        struct MotionTrack {
+            Location positions[constants::MOTION_HISTORY_LENGTH];
+            int count;
+            /// Where the next position goes.
+            int head;
+            int last_seen_turn;
+
+            const Location& newest(const int age) const {
+                const int index = (head - 1 - age + constants::MOTION_HISTORY_LENGTH) % constants::MOTION_HISTORY_LENGTH;
+                return positions[index];
+            }
+        };
+
+        /**
+         * Every ship's recent positions, kept across turns.
+         *
+         * The engine no longer sends velocities, so this is the only way to
+         * tell where a ship is going. Each turn's displacement is what the
+         * ship thrusted last turn; the estimate leans on the latest one and
+         * fades out older ones.
+         */
+        class MotionHistory {
+        private:
+            std::unordered_map<std::uint64_t, MotionTrack> tracks;
+            int current_turn = 0;
+
+            static std::uint64_t key(const PlayerId owner_id, const EntityId ship_id) {
+                return (static_cast<std::uint64_t>(owner_id) << 32) | static_cast<std::uint32_t>(ship_id);
+            }
+
+        public:
+            static MotionHistory& get() {
+                static MotionHistory instance{};
+                return instance;
+            }
+
+            /// Add this turn's positions and forget ships that weren't in it.
+            void record(const Map& map) {
+                current_turn++;
+
+                for (const auto& player_ships : map.ships) {
+                    for (const Ship& ship : player_ships.second) {
+                        MotionTrack& track = tracks[key(player_ships.first, ship.entity_id)];
+                        track.positions[track.head] = ship.location;
+                        track.head = (track.head + 1) % constants::MOTION_HISTORY_LENGTH;
+                        track.count = std::min(track.count + 1, constants::MOTION_HISTORY_LENGTH);
+                        track.last_seen_turn = current_turn;
+                    }
+                }
+
+                for (auto it = tracks.begin(); it != tracks.end();) {
+                    if (it->second.last_seen_turn != current_turn) {
+                        it = tracks.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+
+            /// Expected displacement of a ship over the coming turn, if it has moved before.
+            possibly<Location> predicted_velocity(const PlayerId owner_id, const EntityId ship_id) const {
+                const auto found = tracks.find(key(owner_id, ship_id));
+                if (found == tracks.end() || found->second.count < 2) {
+                    return { Location{ 0, 0 }, false };
+                }
+
+                const MotionTrack& track = found->second;
+                double vel_x = 0;
+                double vel_y = 0;
+                double total_weight = 0;
+                double weight = 1;
+                for (int age = 0; age + 1 < track.count; ++age) {
+                    const Location& to = track.newest(age);
+                    const Location& from = track.newest(age + 1);
+                    vel_x += weight * (to.pos_x - from.pos_x);
+                    vel_y += weight * (to.pos_y - from.pos_y);
+                    total_weight += weight;
+                    weight *= constants::MOTION_HISTORY_DECAY;
+                }
+                vel_x /= total_weight;
+                vel_y /= total_weight;
+
+                const double speed = std::sqrt(vel_x * vel_x + vel_y * vel_y);
+                if (speed > constants::MAX_SPEED) {
+                    vel_x *= constants::MAX_SPEED / speed;
+                    vel_y *= constants::MAX_SPEED / speed;
+                }
+                return { Location{ vel_x, vel_y }, true };
+            }
+
+            /// Heading a ship is most likely to keep, if it is moving at all.
+            possibly<int> predicted_heading_deg(const PlayerId owner_id, const EntityId ship_id) const {
+                const possibly<Location> velocity = predicted_velocity(owner_id, ship_id);
+                if (!velocity.second || (velocity.first.pos_x == 0 && velocity.first.pos_y == 0)) {
+                    return { 0, false };
+                }
+                return { Location{ 0, 0 }.orient_towards_in_deg(velocity.first), true };
+            }
+
+            /**
+             * Give every enemy ship its predicted velocity, so collision and
+             * danger checks work against where it will be rather than where it is.
+             */
+            void apply_predictions(Map& map, const PlayerId player_id) const {
+                for (auto& player_ships : map.ships) {
+                    if (player_ships.first == player_id) {
+                        continue;
+                    }
+                    for (Ship& ship : player_ships.second) {
+                        if (ship.docking_status != ShipDockingStatus::Undocked) {
+                            continue;
+                        }
+                        const possibly<Location> velocity = predicted_velocity(player_ships.first, ship.entity_id);
+                        if (velocity.second) {
+                            ship.velocity.vel_x = velocity.first.pos_x;
+                            ship.velocity.vel_y = velocity.first.pos_y;
+                        }
+                    }
+                }
+            }
+        };
+    }
+}
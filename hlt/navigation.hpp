@@ -1,8 +1,15 @@
 #pragma once
 
+#include "action_space.hpp"
 #include "collision.hpp"
+#include "docking_slots.hpp"
+#include "flow_field.hpp"
 #include "map.hpp"
 #include "move.hpp"
+#include "navigation_cache.hpp"
+#include "orca.hpp"
+#include "profiling.hpp"
+#include "turn_clock.hpp"
 #include "util.hpp"
 
 namespace hlt {
@@ -11,7 +18,12 @@ namespace hlt {
             return (((angle % 360L) + 360L) % 360L);
         }
 
-        static possibly<Move> navigate_ship_towards_target(
+        /// The engine only takes whole degrees, so neither can a correction step.
+        static int correction_step_deg(const double angular_step_rad) {
+            return std::max(1, (int) std::lround(angular_step_rad * 180.0 / M_PI));
+        }
+
+        static possibly<Move> navigate_ship_towards_target_uncached(
                 const Map& map,
                 Ship& ship,
                 const Location& target,
@@ -37,38 +49,244 @@ namespace hlt {
 
             const unsigned short angle_deg = util::angle_rad_to_deg_clipped(angle_rad);
             
-            ship.velocity.vel_x = 0;
-            ship.velocity.vel_y = 0;
-
-            auto angle = angle_deg * M_PI / 180.0;
-            ship.velocity.accelerate_by(thrust, angle);
+            actions::set_velocity(ship.velocity, thrust, angle_deg);
 
             if (collision::will_collide(map, ship, target) == true) {
-                const double new_target_dx = cos((angle_deg * M_PI / 180.0) + angular_step_rad) * distance;
-                const double new_target_dy = sin((angle_deg * M_PI / 180.0) + angular_step_rad) * distance;
-                const Location new_target = { ship.location.pos_x + new_target_dx, ship.location.pos_y + new_target_dy };
+                profiling::count(profiling::Counter::Corrections);
 
-                return navigate_ship_towards_target(
+                const int step_deg = correction_step_deg(angular_step_rad);
+                const Location step = actions::unit_vector(angle_deg + step_deg);
+                const Location new_target = { ship.location.pos_x + step.pos_x * distance, ship.location.pos_y + step.pos_y * distance };
+
+                return navigate_ship_towards_target_uncached(
                         map, ship, new_target, max_thrust, true, (max_corrections - 1), angular_step_rad);
             }
 
             return { Move::thrust(ship.entity_id, thrust, angle_deg), true };
         }
 
+        static possibly<Move> navigate_ship_towards_target(
+                const Map& map,
+                Ship& ship,
+                const Location& target,
+                const int max_thrust,
+                const bool avoid_obstacles,
+                const int full_corrections,
+                const double angular_step_rad)
+        {
+            const profiling::ScopedTimer timer(profiling::Phase::Navigation);
+
+            // search less of the circle as the turn runs out of time
+            const int max_corrections = timing::TurnClock::get().scaled(full_corrections, constants::TURN_MIN_CORRECTIONS);
+
+            if (constants::ENABLE_ORCA_AVOIDANCE && !collision::out_of_bounds(map, target) && orca::in_dense_fight(map, ship)) {
+                // head straight for the target, resolve_local_avoidance sorts out the crowd afterwards
+                const double distance = ship.location.get_distance_to(target);
+                const int thrust = distance < max_thrust ? (int) distance : max_thrust;
+                const int angle_deg = ship.location.orient_towards_in_deg(target);
+
+                actions::set_velocity(ship.velocity, thrust, angle_deg);
+                ship.needs_local_avoidance = true;
+                ship.avoidance_target = target;
+
+                return { Move::thrust(ship.entity_id, thrust, angle_deg), true };
+            }
+
+            NavigationCache& cache = NavigationCache::get();
+            const std::uint64_t signature = NavigationCache::obstacle_signature(map, ship);
+            const int bearing_deg = ship.location.orient_towards_in_deg(target);
+
+            // only replay a correction the search could still reach with this turn's budget of steps
+            const possibly<int> cached = cache.lookup(ship, target, signature);
+            if (cached.second && cached.first < max_corrections * correction_step_deg(angular_step_rad)) {
+                // replay last turn's correction and make sure it is still clear
+                const double distance = ship.location.get_distance_to(target);
+                const int thrust = distance < max_thrust ? (int) distance : max_thrust;
+                const int angle_deg = clip_angle(bearing_deg + cached.first);
+
+                actions::set_velocity(ship.velocity, thrust, angle_deg);
+
+                const Location heading = actions::unit_vector(angle_deg);
+                const Location corrected_target = {
+                        ship.location.pos_x + heading.pos_x * distance,
+                        ship.location.pos_y + heading.pos_y * distance };
+                if (!collision::will_collide(map, ship, corrected_target)) {
+                    cache.hits++;
+                    return { Move::thrust(ship.entity_id, thrust, angle_deg), true };
+                }
+            }
+            cache.misses++;
+
+            const possibly<Move> move = navigate_ship_towards_target_uncached(
+                    map, ship, target, max_thrust, avoid_obstacles, max_corrections, angular_step_rad);
+            if (move.second) {
+                cache.store(ship, target, signature, clip_angle(move.first.move_angle_deg - bearing_deg));
+            }
+
+            return move;
+        }
+
         static possibly<Move> navigate_ship_to_dock(
                 const Map& map,
                 Ship& ship,
-                const Entity& dock_target,
+                const Planet& dock_target,
                 const int max_thrust)
         {
             const int max_corrections = constants::MAX_NAVIGATION_CORRECTIONS;
             const bool avoid_obstacles = true;
             const double angular_step_rad = M_PI / 180.0;
-            const double max_dist = 0; //constants::DOCK_RADIUS + dock_target.radius - constants::SHIP_RADIUS - constants::SHIP_RADIUS - constants::SHIP_RADIUS;
-            const Location& target = ship.location.get_closest_point(dock_target.location, max_dist);
 
-            return navigate_ship_towards_target(
-                    map, ship, target, max_thrust, avoid_obstacles, max_corrections, angular_step_rad);
+            // head for our own approach slot so ships spread around the planet, claiming it once we
+            // have a way there; with every slot taken, head halfway into the docking range like before slots
+            docking::DockingSlots& slots = docking::DockingSlots::get();
+            const possibly<Location> slot = slots.peek(dock_target, ship);
+            const Location target = slot.second ? slot.first : ship.location.get_closest_point(
+                    dock_target.location, dock_target.radius + constants::SHIP_RADIUS + constants::DOCK_RADIUS / 2);
+            const auto claim_if_moving = [&](const possibly<Move>& move) {
+                if (move.second && slot.second) {
+                    slots.reserve(dock_target, ship);
+                }
+                return move;
+            };
+
+            // when a planet sits between us and the target, steer along the shared
+            // flow field instead of searching for a way around it ourselves
+            if (!collision::objects_between(map, ship.location, target, false, true).empty()) {
+                const FlowField& field = FlowFieldCache::get().towards_planet(map, dock_target);
+                const possibly<Location> waypoint = field.waypoint(ship.location);
+                if (waypoint.second) {
+                    return claim_if_moving(navigate_ship_towards_target(
+                            map, ship, waypoint.first, max_thrust, avoid_obstacles, max_corrections, angular_step_rad));
+                }
+            }
+
+            return claim_if_moving(navigate_ship_towards_target(
+                    map, ship, target, max_thrust, avoid_obstacles, max_corrections, angular_step_rad));
+        }
+    
+        /**
+         * Give every ship that navigation deferred to local avoidance a velocity
+         * from the ORCA half-planes of its neighbours, all at once. Ships whose
+         * snapped velocity still collides fall back to the heading search.
+         */
+        static void resolve_local_avoidance(Map& map, const PlayerId player_id, std::vector<Move>& moves) {
+            std::vector<Ship *> pending;
+            for (Ship& ship : map.ships.at(player_id)) {
+                if (ship.needs_local_avoidance) {
+                    pending.push_back(&ship);
+                }
+            }
+
+            if (pending.empty()) {
+                return;
+            }
+
+            const double ship_radius = constants::SHIP_RADIUS + constants::FORECAST_FUDGE_FACTOR / 2;
+            std::vector<orca::Line> lines;
+            std::vector<orca::Line> scratch;
+            std::vector<orca::Vector2> velocities;
+
+            for (Ship* ship : pending) {
+                const orca::Agent self = {
+                        { ship->location.pos_x, ship->location.pos_y },
+                        { (double) ship->velocity.vel_x, (double) ship->velocity.vel_y },
+                        ship_radius };
+
+                lines.clear();
+                for (const Planet& planet : map.planets) {
+                    const double reach = constants::MAX_SPEED * constants::ORCA_TIME_HORIZON + planet.radius + ship_radius;
+                    if (ship->location.get_distance_to(planet.location) > reach) {
+                        continue;
+                    }
+
+                    const orca::Agent obstacle = { { planet.location.pos_x, planet.location.pos_y }, { 0, 0 }, planet.radius };
+                    lines.push_back(orca::velocity_obstacle(self, obstacle, constants::ORCA_TIME_HORIZON, 1.0));
+                }
+
+                for (const auto& player_ship : map.ships) {
+                    for (const Ship& ship2 : player_ship.second) {
+                        if (&ship2 == ship || ship->location.get_distance_to(ship2.location) > constants::ORCA_NEIGHBOUR_RADIUS) {
+                            continue;
+                        }
+
+                        const orca::Agent other = {
+                                { ship2.location.pos_x, ship2.location.pos_y },
+                                { (double) ship2.velocity.vel_x, (double) ship2.velocity.vel_y },
+                                ship_radius };
+                        // only our own deferred ships are guaranteed to meet us halfway
+                        const double responsibility = ship2.needs_local_avoidance ? 0.5 : 1.0;
+                        lines.push_back(orca::velocity_obstacle(self, other, constants::ORCA_TIME_HORIZON, responsibility));
+                    }
+                }
+
+                velocities.push_back(orca::solve(lines, self.velocity, constants::MAX_SPEED, scratch));
+            }
+
+            // snap to what the engine accepts before anyone is checked
+            std::vector<Move> resolved;
+            for (size_t i = 0; i < pending.size(); ++i) {
+                Ship& ship = *pending[i];
+                const int thrust = std::min(constants::MAX_SPEED, (int) (velocities[i].abs() + 0.000001));
+                const int angle_deg = util::angle_rad_to_deg_clipped(fast_math::atan2(velocities[i].y, velocities[i].x));
+
+                actions::set_velocity(ship.velocity, thrust, angle_deg);
+                resolved.push_back(Move::thrust(ship.entity_id, thrust, angle_deg));
+            }
+
+            // A ship that collides falls back to the heading search, and if that doesn't
+            // clear it either, stops. Either changes its velocity, which the ships checked
+            // before it never saw, so everyone is checked again until a pass changes nobody.
+            // A ship is changed at most twice, so this ends.
+            std::vector<int> changes(pending.size(), 0);
+            int fallbacks = 0;
+            bool has_changed = true;
+            while (has_changed) {
+                has_changed = false;
+                for (size_t i = 0; i < pending.size(); ++i) {
+                    Ship& ship = *pending[i];
+                    if (changes[i] == 2) {
+                        continue;
+                    }
+
+                    const Location end = {
+                            ship.location.pos_x + (double) ship.velocity.vel_x,
+                            ship.location.pos_y + (double) ship.velocity.vel_y };
+                    if (!collision::will_collide(map, ship, end)) {
+                        continue;
+                    }
+                    has_changed = true;
+
+                    if (changes[i]++ == 0) {
+                        fallbacks++;
+                        const possibly<Move> fallback = navigate_ship_towards_target_uncached(
+                                map, ship, ship.avoidance_target, constants::MAX_SPEED, true,
+                                constants::MAX_NAVIGATION_CORRECTIONS, M_PI / 180.0);
+                        if (fallback.second) {
+                            resolved[i] = fallback.first;
+                            continue;
+                        }
+                        changes[i] = 2;
+                    }
+
+                    ship.velocity.vel_x = 0;
+                    ship.velocity.vel_y = 0;
+                    resolved[i] = Move::thrust(ship.entity_id, 0, 0);
+                }
+            }
+
+            for (size_t i = 0; i < pending.size(); ++i) {
+                Ship& ship = *pending[i];
+                ship.needs_local_avoidance = false;
+
+                for (Move& move : moves) {
+                    if (move.type == MoveType::Thrust && move.ship_id == ship.entity_id) {
+                        move = resolved[i];
+                    }
+                }
+            }
+
+            Log::log("local avoidance: " + std::to_string(pending.size()) + " ships; " +
+                std::to_string(fallbacks) + " fell back to heading search");
         }
     }
 }
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#include <mutex>
+
+#include "map.hpp"
+
+namespace hlt {
+    namespace navigation {
+        /// The heading a ship settled on the last time it navigated.
+        struct CachedNavigation {
+            Location target;
+            std::uint64_t obstacle_signature;
+            int turn;
+
+            /// Degrees added to the direct bearing by the correction search.
+            int correction_deg;
+        };
+
+        /**
+         * Remembers each of our ships' last navigation answer across turns.
+         *
+         * An answer is only handed back when the ship is still heading for
+         * the same target and nothing within reach has moved since, so the
+         * caller only has to re-run a single collision check instead of the
+         * whole correction search.
+         */
+        class NavigationCache {
+        private:
+            entity_map<CachedNavigation> entries;
+            int current_turn = 0;
+            /// Ships may be planned from several threads at once.
+            mutable std::mutex mutex;
+
+            static std::uint64_t mix(std::uint64_t hash, const std::int64_t value) {
+                // FNV-1a over the bytes of value
+                for (int i = 0; i < 8; ++i) {
+                    hash ^= static_cast<std::uint64_t>((value >> (i * 8)) & 0xff);
+                    hash *= 1099511628211ULL;
+                }
+                return hash;
+            }
+
+        public:
+            std::atomic<unsigned int> hits{0};
+            std::atomic<unsigned int> misses{0};
+
+            static NavigationCache& get() {
+                static NavigationCache instance{};
+                return instance;
+            }
+
+            /// Forget ships that died and start counting for a new turn.
+            void begin_turn(const Map& map, const PlayerId player_id) {
+                current_turn++;
+                hits = 0;
+                misses = 0;
+
+                const auto owned = map.ship_map.find(player_id);
+                if (owned == map.ship_map.end()) {
+                    entries.clear();
+                    return;
+                }
+
+                const auto& alive = owned->second;
+                for (auto it = entries.begin(); it != entries.end();) {
+                    if (alive.find(it->first) == alive.end()) {
+                        it = entries.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+
+            /**
+             * Hash of everything the ship could run into this turn.
+             *
+             * Planets never move so their id is enough, ships are hashed by
+             * their position snapped to a NAVIGATION_CACHE_CELL grid. Our own
+             * undocked ships are left out as they are planned this turn and
+             * the replayed heading gets a full collision check against them.
+             */
+            static std::uint64_t obstacle_signature(const Map& map, const Ship& ship) {
+                std::uint64_t hash = 14695981039346656037ULL;
+                const double ship_reach = 2 * constants::MAX_SPEED + 2 * constants::SHIP_RADIUS;
+
+                for (const Planet& planet : map.planets) {
+                    const double reach = constants::MAX_SPEED + planet.radius + ship.radius;
+                    if (ship.location.get_distance_to(planet.location) <= reach) {
+                        hash = mix(hash, planet.entity_id);
+                    }
+                }
+
+                for (const auto& player_ship : map.ships) {
+                    for (const Ship& ship2 : player_ship.second) {
+                        if (ship2.owner_id == ship.owner_id && ship2.docking_status == ShipDockingStatus::Undocked) {
+                            // our own moving ships are re-checked by will_collide anyway
+                            continue;
+                        }
+                        if (ship.location.get_distance_to(ship2.location) > ship_reach) {
+                            continue;
+                        }
+
+                        const double cell = constants::NAVIGATION_CACHE_CELL;
+                        hash = mix(hash, player_ship.first);
+                        hash = mix(hash, ship2.entity_id);
+                        hash = mix(hash, static_cast<std::int64_t>(std::floor(ship2.location.pos_x / cell)));
+                        hash = mix(hash, static_cast<std::int64_t>(std::floor(ship2.location.pos_y / cell)));
+                    }
+                }
+
+                return hash;
+            }
+
+            /// Returns last turn's answer if the target and surroundings still match.
+            possibly<int> lookup(const Ship& ship, const Location& target, const std::uint64_t signature) {
+                std::lock_guard<std::mutex> lock(mutex);
+                const auto it = entries.find(ship.entity_id);
+                if (it == entries.end()) {
+                    return { 0, false };
+                }
+
+                const CachedNavigation& entry = it->second;
+                if (entry.turn < current_turn - 1 ||
+                    entry.obstacle_signature != signature ||
+                    entry.target.get_distance_to(target) > constants::NAVIGATION_CACHE_TARGET_TOLERANCE) {
+                    return { 0, false };
+                }
+
+                return { entry.correction_deg, true };
+            }
+
+            void store(const Ship& ship, const Location& target, const std::uint64_t signature, const int correction_deg) {
+                std::lock_guard<std::mutex> lock(mutex);
+                entries[ship.entity_id] = { target, signature, current_turn, correction_deg };
+            }
+        };
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vector>
+
+#include "docking_slots.hpp"
+#include "economy.hpp"
+#include "engagement.hpp"
+#include "flow_field.hpp"
+#include "influence_map.hpp"
+#include "map.hpp"
+#include "thread_pool.hpp"
+
+namespace hlt {
+    namespace opening {
+        struct RushPlan {
+            bool should_rush;
+            PlayerId target;
+        };
+
+        /**
+         * Whether ship's whole fleet can kill the player owning the enemy ship
+         * closest to it before that player gets a new ship out.
+         */
+        static bool can_rush_from(const Map& map, const PlayerId player_id, const Ship& ship, PlayerId& target) {
+            const Ship* closest_enemy_ship = nullptr;
+            double closest_distance = 0;
+            for (const auto& player_ships : map.ships) {
+                if (player_ships.first == player_id) {
+                    continue;
+                }
+                for (const Ship& enemy_ship : player_ships.second) {
+                    const double distance = ship.location.distance(enemy_ship.location);
+                    if (closest_enemy_ship == nullptr || distance < closest_distance) {
+                        closest_enemy_ship = &enemy_ship;
+                        closest_distance = distance;
+                    }
+                }
+            }
+
+            if (closest_enemy_ship == nullptr) {
+                return false;
+            }
+            target = closest_enemy_ship->owner_id;
+
+            // how long until they have a new ship if their whole fleet docks straight away
+            int time_to_build_new_ship = economy::EconomyForecast::turns_to_first_spawn(map.ships.at(target).size());
+
+            auto distance_to_closest_planet = 99999;
+            const Planet* closest_planet = nullptr;
+            for (const Planet& planet : map.planets) {
+                auto planet_to_enemy_distance = closest_enemy_ship->location.distance(planet.location);
+                if (planet_to_enemy_distance < distance_to_closest_planet) {
+                    distance_to_closest_planet = planet_to_enemy_distance;
+                    closest_planet = &planet;
+                }
+            }
+
+            if (closest_planet != nullptr) {
+                // calculate how long it takes to reach a location our enemy can dock at
+                const double max_dist_to_dock = constants::DOCK_RADIUS + closest_planet->radius - constants::SHIP_RADIUS;
+                Location closest_location = closest_enemy_ship->location.get_closest_point(closest_planet->location, max_dist_to_dock);
+                time_to_build_new_ship += closest_enemy_ship->location.distance(closest_location) / constants::MAX_SPEED;
+            }
+
+            // play out our fleet flying over and shooting their ships while they sit docked
+            combat::Engagement rush;
+            for (const Ship& our_ship : map.ships.at(player_id)) {
+                rush.add(our_ship);
+            }
+            for (const Ship& enemy_ship : map.ships.at(target)) {
+                combat::Combatant docked_enemy = combat::to_combatant(enemy_ship);
+                docked_enemy.is_docked = true;
+                rush.add(docked_enemy);
+            }
+
+            // by the time one ship is dead, the delay to make another will increase, making it take longer to make another ship
+            const combat::EngagementOutcome outcome = rush.simulate(constants::RUSH_SIMULATION_TURNS);
+            const int time_to_kill_enemy_ships = outcome.survivors[target] == 0 ?
+                outcome.turns : constants::RUSH_SIMULATION_TURNS;
+
+            return time_to_kill_enemy_ships < time_to_build_new_ship;
+        }
+
+        /**
+         * Run the rush check from every one of our ships at once. The first ship,
+         * in fleet order, that finds a rush picks the target, which is what
+         * checking them one at a time would give.
+         */
+        static RushPlan analyse_rush(const Map& map, const PlayerId player_id, ThreadPool& pool) {
+            const std::vector<Ship>& fleet = map.ships.at(player_id);
+            std::vector<char> can_rush(fleet.size(), 0);
+            std::vector<PlayerId> targets(fleet.size(), -1);
+
+            TaskGroup checks;
+            for (size_t i = 0; i < fleet.size(); ++i) {
+                pool.run(checks, [&, i] {
+                    can_rush[i] = can_rush_from(map, player_id, fleet[i], targets[i]);
+                });
+            }
+            pool.wait(checks);
+
+            for (size_t i = 0; i < fleet.size(); ++i) {
+                if (can_rush[i]) {
+                    return { true, targets[i] };
+                }
+            }
+            return { false, -1 };
+        }
+
+        /**
+         * Build everything that only depends on the planets and pay for the
+         * first allocations now, so turn one doesn't have to.
+         */
+        static void warm_up(const Map& map, const PlayerId player_id) {
+            docking::DockingSlots::get().build(map);
+
+            actions::displacements();
+
+            navigation::FlowFieldCache& flow_fields = navigation::FlowFieldCache::get();
+            for (const Planet& planet : map.planets) {
+                flow_fields.towards_planet(map, planet);
+            }
+
+            combat::InfluenceMap::get().build(map, player_id);
+        }
+    }
+}
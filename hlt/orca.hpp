@@ -0,0 +1,282 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "map.hpp"
+
+namespace hlt {
+    namespace orca {
+        struct Vector2 {
+            double x, y;
+
+            Vector2 operator+(const Vector2& other) const { return { x + other.x, y + other.y }; }
+            Vector2 operator-(const Vector2& other) const { return { x - other.x, y - other.y }; }
+            Vector2 operator-() const { return { -x, -y }; }
+            Vector2 operator*(const double scale) const { return { x * scale, y * scale }; }
+            double operator*(const Vector2& other) const { return x * other.x + y * other.y; }
+
+            double abs_sq() const { return x * x + y * y; }
+            double abs() const { return std::sqrt(abs_sq()); }
+            Vector2 normalized() const { return *this * (1.0 / abs()); }
+        };
+
+        static double det(const Vector2& v1, const Vector2& v2) {
+            return v1.x * v2.y - v1.y * v2.x;
+        }
+
+        /// Half-plane of permitted velocities: everything left of direction through point.
+        struct Line {
+            Vector2 point;
+            Vector2 direction;
+        };
+
+        /// Something a ship has to keep clear of, as seen by the avoidance solver.
+        struct Agent {
+            Vector2 position;
+            Vector2 velocity;
+            double radius;
+        };
+
+        constexpr double EPSILON = 0.00001;
+
+        /**
+         * The ORCA half-plane self has to stay in so that it does not hit other
+         * within time_horizon turns. responsibility is the share of the
+         * avoidance self takes on: 0.5 when other is doing the same, 1 when
+         * other will not move out of the way.
+         */
+        static Line velocity_obstacle(
+                const Agent& self,
+                const Agent& other,
+                const double time_horizon,
+                const double responsibility)
+        {
+            const Vector2 relative_position = other.position - self.position;
+            const Vector2 relative_velocity = self.velocity - other.velocity;
+            const double dist_sq = relative_position.abs_sq();
+            const double combined_radius = self.radius + other.radius;
+            const double combined_radius_sq = combined_radius * combined_radius;
+            const double inv_time_horizon = 1.0 / time_horizon;
+
+            Line line;
+            Vector2 u;
+
+            if (dist_sq > combined_radius_sq) {
+                // vector from cutoff center to relative velocity
+                const Vector2 w = relative_velocity - relative_position * inv_time_horizon;
+                const double w_length_sq = w.abs_sq();
+                const double dot_product = w * relative_position;
+
+                if (dot_product < 0.0 && dot_product * dot_product > combined_radius_sq * w_length_sq) {
+                    // project on the cut-off circle
+                    const double w_length = std::sqrt(w_length_sq);
+                    const Vector2 unit_w = w * (1.0 / w_length);
+
+                    line.direction = { unit_w.y, -unit_w.x };
+                    u = unit_w * (combined_radius * inv_time_horizon - w_length);
+                } else {
+                    // project on the legs of the cone
+                    const double leg = std::sqrt(dist_sq - combined_radius_sq);
+
+                    if (det(relative_position, w) > 0.0) {
+                        line.direction = Vector2{
+                                relative_position.x * leg - relative_position.y * combined_radius,
+                                relative_position.x * combined_radius + relative_position.y * leg } * (1.0 / dist_sq);
+                    } else {
+                        line.direction = -Vector2{
+                                relative_position.x * leg + relative_position.y * combined_radius,
+                                -relative_position.x * combined_radius + relative_position.y * leg } * (1.0 / dist_sq);
+                    }
+
+                    u = line.direction * (relative_velocity * line.direction) - relative_velocity;
+                }
+            } else {
+                // already overlapping, get apart within this turn
+                const Vector2 w = relative_velocity - relative_position;
+                const double w_length = w.abs();
+                const Vector2 unit_w = w * (1.0 / w_length);
+
+                line.direction = { unit_w.y, -unit_w.x };
+                u = unit_w * (combined_radius - w_length);
+            }
+
+            line.point = self.velocity + u * responsibility;
+            return line;
+        }
+
+        /// Solve along the boundary of line line_no, subject to lines [0, line_no).
+        static bool linear_program_1(
+                const std::vector<Line>& lines,
+                const size_t line_no,
+                const double radius,
+                const Vector2& optimal,
+                const bool direction_opt,
+                Vector2& result)
+        {
+            const Line& line = lines[line_no];
+            const double dot_product = line.point * line.direction;
+            const double discriminant = dot_product * dot_product + radius * radius - line.point.abs_sq();
+
+            if (discriminant < 0.0) {
+                // max speed circle fully invalidates this line
+                return false;
+            }
+
+            const double sqrt_discriminant = std::sqrt(discriminant);
+            double t_left = -dot_product - sqrt_discriminant;
+            double t_right = -dot_product + sqrt_discriminant;
+
+            for (size_t i = 0; i < line_no; ++i) {
+                const double denominator = det(line.direction, lines[i].direction);
+                const double numerator = det(lines[i].direction, line.point - lines[i].point);
+
+                if (std::fabs(denominator) <= EPSILON) {
+                    // lines are (almost) parallel
+                    if (numerator < 0.0) {
+                        return false;
+                    }
+                    continue;
+                }
+
+                const double t = numerator / denominator;
+                if (denominator >= 0.0) {
+                    t_right = std::min(t_right, t);
+                } else {
+                    t_left = std::max(t_left, t);
+                }
+
+                if (t_left > t_right) {
+                    return false;
+                }
+            }
+
+            if (direction_opt) {
+                result = line.point + line.direction * (optimal * line.direction > 0.0 ? t_right : t_left);
+            } else {
+                const double t = line.direction * (optimal - line.point);
+                result = line.point + line.direction * std::max(t_left, std::min(t_right, t));
+            }
+
+            return true;
+        }
+
+        /// Returns lines.size() on success, otherwise the index of the line that failed.
+        static size_t linear_program_2(
+                const std::vector<Line>& lines,
+                const double radius,
+                const Vector2& optimal,
+                const bool direction_opt,
+                Vector2& result)
+        {
+            if (direction_opt) {
+                result = optimal * radius;
+            } else if (optimal.abs_sq() > radius * radius) {
+                result = optimal.normalized() * radius;
+            } else {
+                result = optimal;
+            }
+
+            for (size_t i = 0; i < lines.size(); ++i) {
+                if (det(lines[i].direction, lines[i].point - result) > 0.0) {
+                    const Vector2 previous = result;
+                    if (!linear_program_1(lines, i, radius, optimal, direction_opt, result)) {
+                        result = previous;
+                        return i;
+                    }
+                }
+            }
+
+            return lines.size();
+        }
+
+        /// Infeasible case: find the velocity that violates the constraints the least.
+        static void linear_program_3(
+                const std::vector<Line>& lines,
+                const size_t begin_line,
+                const double radius,
+                Vector2& result,
+                std::vector<Line>& projected_lines)
+        {
+            double distance = 0.0;
+
+            for (size_t i = begin_line; i < lines.size(); ++i) {
+                if (det(lines[i].direction, lines[i].point - result) <= distance) {
+                    continue;
+                }
+
+                projected_lines.clear();
+                for (size_t j = 0; j < i; ++j) {
+                    Line line;
+                    const double determinant = det(lines[i].direction, lines[j].direction);
+
+                    if (std::fabs(determinant) <= EPSILON) {
+                        if (lines[i].direction * lines[j].direction > 0.0) {
+                            // same direction
+                            continue;
+                        }
+                        line.point = (lines[i].point + lines[j].point) * 0.5;
+                    } else {
+                        line.point = lines[i].point + lines[i].direction *
+                                (det(lines[j].direction, lines[i].point - lines[j].point) / determinant);
+                    }
+
+                    line.direction = (lines[j].direction - lines[i].direction).normalized();
+                    projected_lines.push_back(line);
+                }
+
+                const Vector2 previous = result;
+                const Vector2 perpendicular = { -lines[i].direction.y, lines[i].direction.x };
+                if (linear_program_2(projected_lines, radius, perpendicular, true, result) < projected_lines.size()) {
+                    // can only happen through floating point error, keep what we had
+                    result = previous;
+                }
+
+                distance = det(lines[i].direction, lines[i].point - result);
+            }
+        }
+
+        /**
+         * Velocity closest to preferred that stays in every half-plane, or
+         * the least bad one if they cannot all be satisfied.
+         */
+        static Vector2 solve(
+                const std::vector<Line>& lines,
+                const Vector2& preferred,
+                const double max_speed,
+                std::vector<Line>& scratch)
+        {
+            Vector2 result = { 0, 0 };
+            const size_t failed = linear_program_2(lines, max_speed, preferred, false, result);
+            if (failed < lines.size()) {
+                linear_program_3(lines, failed, max_speed, result, scratch);
+            }
+            return result;
+        }
+
+        /// True when a ship is in the middle of a crowded fight.
+        static bool in_dense_fight(const Map& map, const Ship& ship) {
+            int neighbours = 0;
+            bool enemy_nearby = false;
+
+            for (const auto& player_ship : map.ships) {
+                for (const Ship& ship2 : player_ship.second) {
+                    if (ship2.docking_status != ShipDockingStatus::Undocked) {
+                        continue;
+                    }
+                    if (ship2.entity_id == ship.entity_id && ship2.owner_id == ship.owner_id) {
+                        continue;
+                    }
+                    if (ship.location.get_distance_to(ship2.location) > constants::ORCA_NEIGHBOUR_RADIUS) {
+                        continue;
+                    }
+
+                    neighbours++;
+                    enemy_nearby |= ship2.owner_id != ship.owner_id;
+                }
+            }
+
+            return enemy_nearby && neighbours >= constants::ORCA_DENSE_NEIGHBOURS;
+        }
+    }
+}
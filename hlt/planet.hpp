@@ -7,8 +7,6 @@
 
 namespace hlt {
     struct Planet : Entity {
-        std::vector<NearbyEntity> ships_moving_towards;
-
         bool is_owned;
         
         bool is_owned_by(hlt::PlayerId player_id) {
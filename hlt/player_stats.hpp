@@ -0,0 +1,124 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "map.hpp"
+
+namespace hlt {
+    namespace stats {
+        struct PlayerStats {
+            int ships;
+            int undocked;
+            int docking;
+            int docked;
+            int undocking;
+
+            int planets_owned;
+            /// Production all the player's planets add this turn.
+            int production_rate;
+            long total_health;
+        };
+
+        /**
+         * Totals for every player, filled in one pass over the frame right
+         * after it is parsed, so strategy code reads them instead of looping
+         * over every ship again. Last turn's totals are kept alongside for
+         * telling how things changed.
+         */
+        class PlayerStatsTable {
+        private:
+            std::unordered_map<PlayerId, PlayerStats> current;
+            std::unordered_map<PlayerId, PlayerStats> previous;
+            PlayerStats all_players = {};
+            PlayerStats empty = {};
+
+        public:
+            static PlayerStatsTable& get() {
+                static PlayerStatsTable instance{};
+                return instance;
+            }
+
+            void update(const Map& map) {
+                current.swap(previous);
+                current.clear();
+                all_players = {};
+
+                for (const auto& player_ships : map.ships) {
+                    PlayerStats& player = current[player_ships.first];
+                    player = {};
+                    for (const Ship& ship : player_ships.second) {
+                        player.ships++;
+                        player.total_health += ship.health;
+                        switch (ship.docking_status) {
+                            case ShipDockingStatus::Undocked:
+                                player.undocked++;
+                                break;
+                            case ShipDockingStatus::Docking:
+                                player.docking++;
+                                break;
+                            case ShipDockingStatus::Docked:
+                                player.docked++;
+                                break;
+                            case ShipDockingStatus::Undocking:
+                                player.undocking++;
+                                break;
+                        }
+                    }
+                }
+
+                for (const Planet& planet : map.planets) {
+                    if (!planet.is_owned) {
+                        continue;
+                    }
+                    const auto owner = current.find(planet.owner_id);
+                    if (owner == current.end()) {
+                        continue;
+                    }
+                    owner->second.planets_owned++;
+
+                    int producing = 0;
+                    const std::vector<Ship>& owner_ships = map.ships.at(planet.owner_id);
+                    const entity_map<unsigned int>& owner_index = map.ship_map.at(planet.owner_id);
+                    for (const EntityId ship_id : planet.docked_ships) {
+                        const auto index = owner_index.find(ship_id);
+                        if (index != owner_index.end() &&
+                            owner_ships[index->second].docking_status == ShipDockingStatus::Docked) {
+                            producing++;
+                        }
+                    }
+                    owner->second.production_rate +=
+                        std::min(planet.remaining_production, producing * constants::BASE_PRODUCTIVITY);
+                }
+
+                for (const auto& entry : current) {
+                    const PlayerStats& player = entry.second;
+                    all_players.ships += player.ships;
+                    all_players.undocked += player.undocked;
+                    all_players.docking += player.docking;
+                    all_players.docked += player.docked;
+                    all_players.undocking += player.undocking;
+                    all_players.planets_owned += player.planets_owned;
+                    all_players.production_rate += player.production_rate;
+                    all_players.total_health += player.total_health;
+                }
+            }
+
+            /// This turn's totals for a player; all zero for a player not in the frame.
+            const PlayerStats& of(const PlayerId player_id) const {
+                const auto found = current.find(player_id);
+                return found == current.end() ? empty : found->second;
+            }
+
+            /// Last turn's totals for a player.
+            const PlayerStats& last_turn(const PlayerId player_id) const {
+                const auto found = previous.find(player_id);
+                return found == previous.end() ? empty : found->second;
+            }
+
+            /// This turn's totals summed over every player.
+            const PlayerStats& total() const {
+                return all_players;
+            }
+        };
+    }
+}
@@ -0,0 +1,437 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "constants.hpp"
+
+namespace hlt {
+    namespace profiling {
+        enum class Phase : unsigned char {
+            Parse,
+            NearbyEntities,
+            AbandonCheck,
+            Planning,
+            Abandonment,
+            Rush,
+            HandleShip,
+            Navigation,
+            CollisionCheck,
+            SendMoves,
+        };
+        constexpr unsigned int PHASE_COUNT = 10;
+
+        enum class Counter : unsigned char {
+            WillCollide,
+            /// Headings navigation turned away from because they collided.
+            Corrections,
+        };
+        constexpr unsigned int COUNTER_COUNT = 2;
+
+        static std::string to_string(const Phase phase) {
+            switch (phase) {
+                case Phase::Parse:
+                    return "parse";
+                case Phase::NearbyEntities:
+                    return "nearby_entities";
+                case Phase::AbandonCheck:
+                    return "abandon_check";
+                case Phase::Planning:
+                    return "planning";
+                case Phase::Abandonment:
+                    return "abandonment";
+                case Phase::Rush:
+                    return "rush";
+                case Phase::HandleShip:
+                    return "handle_ship";
+                case Phase::Navigation:
+                    return "navigation";
+                case Phase::CollisionCheck:
+                    return "collision_check";
+                case Phase::SendMoves:
+                    return "send_moves";
+            }
+            return "unknown";
+        }
+
+        static std::string to_string(const Counter counter) {
+            switch (counter) {
+                case Counter::WillCollide:
+                    return "will_collide";
+                case Counter::Corrections:
+                    return "corrections";
+            }
+            return "unknown";
+        }
+
+        struct Event {
+            Phase phase;
+            int turn;
+            /// Nanoseconds since the profiler started.
+            std::int64_t start_ns;
+            std::int64_t duration_ns;
+        };
+
+        /**
+         * What one thread has recorded. Only that thread writes to it, so
+         * recording takes no lock: an event is written into its slot and then
+         * published by bumping the count, and readers only look at published
+         * slots. Events go in fixed blocks that never move once handed out.
+         */
+        class ThreadBuffer {
+        private:
+            static constexpr unsigned int BLOCK_EVENTS = 4096;
+            static constexpr unsigned int MAX_BLOCKS =
+                (constants::PROFILING_MAX_EVENTS_PER_THREAD + BLOCK_EVENTS - 1) / BLOCK_EVENTS;
+
+            struct Block {
+                Event events[BLOCK_EVENTS];
+            };
+
+            std::array<std::atomic<Block*>, MAX_BLOCKS> blocks;
+            std::atomic<std::size_t> published;
+            std::array<std::atomic<std::uint64_t>, COUNTER_COUNT> counters;
+
+        public:
+            const unsigned int thread_index;
+            std::atomic<std::uint64_t> dropped;
+
+            explicit ThreadBuffer(const unsigned int index) : published(0), thread_index(index), dropped(0) {
+                for (std::atomic<Block*>& block : blocks) {
+                    block = nullptr;
+                }
+                for (std::atomic<std::uint64_t>& counter : counters) {
+                    counter = 0;
+                }
+            }
+
+            ~ThreadBuffer() {
+                for (std::atomic<Block*>& block : blocks) {
+                    delete block.load();
+                }
+            }
+
+            ThreadBuffer(const ThreadBuffer&) = delete;
+            ThreadBuffer& operator=(const ThreadBuffer&) = delete;
+
+            void record(const Event& event) {
+                const std::size_t index = published.load(std::memory_order_relaxed);
+                if (index / BLOCK_EVENTS >= MAX_BLOCKS) {
+                    dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    return;
+                }
+                std::atomic<Block*>& block = blocks[index / BLOCK_EVENTS];
+                if (block.load(std::memory_order_relaxed) == nullptr) {
+                    block.store(new Block(), std::memory_order_relaxed);
+                }
+                block.load(std::memory_order_relaxed)->events[index % BLOCK_EVENTS] = event;
+                published.store(index + 1, std::memory_order_release);
+            }
+
+            void count(const Counter counter, const std::uint64_t amount) {
+                std::atomic<std::uint64_t>& total = counters[static_cast<unsigned int>(counter)];
+                total.store(total.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+            }
+
+            std::uint64_t counted(const Counter counter) const {
+                return counters[static_cast<unsigned int>(counter)].load(std::memory_order_relaxed);
+            }
+
+            /// Events recorded so far, safe to call from any thread.
+            std::size_t size() const {
+                return published.load(std::memory_order_acquire);
+            }
+
+            /// Only for i < size().
+            const Event& at(const std::size_t i) const {
+                return blocks[i / BLOCK_EVENTS].load(std::memory_order_relaxed)->events[i % BLOCK_EVENTS];
+            }
+        };
+
+        /**
+         * Collects timed phases and counters from every thread and writes
+         * them out when the game ends: a histogram per phase and counters
+         * per turn to <name>.profile.txt, and every event to
+         * <name>.trace.json, which chrome://tracing and Perfetto open.
+         *
+         * Nothing here is touched unless ENABLE_PROFILING is on.
+         */
+        class Profiler {
+        private:
+            typedef std::chrono::steady_clock clock;
+
+            /// Durations are bucketed by powers of two nanoseconds.
+            static constexpr unsigned int BUCKETS = 40;
+
+            const clock::time_point started = clock::now();
+            std::atomic<int> current_turn;
+            std::string name;
+
+            std::mutex threads_mutex;
+            std::vector<std::unique_ptr<ThreadBuffer>> threads;
+
+            /// Counter totals over all threads at the start of each turn, kept by the thread reading frames.
+            std::vector<std::array<std::uint64_t, COUNTER_COUNT>> turn_counters;
+            std::vector<std::int64_t> turn_starts_ns;
+
+            Profiler() : current_turn(0) {
+            }
+
+            std::array<std::uint64_t, COUNTER_COUNT> counter_totals() {
+                std::array<std::uint64_t, COUNTER_COUNT> totals{};
+                std::lock_guard<std::mutex> lock(threads_mutex);
+                for (const std::unique_ptr<ThreadBuffer>& thread : threads) {
+                    for (unsigned int i = 0; i < COUNTER_COUNT; ++i) {
+                        totals[i] += thread->counted(static_cast<Counter>(i));
+                    }
+                }
+                return totals;
+            }
+
+            static unsigned int bucket_of(const std::int64_t duration_ns) {
+                unsigned int bucket = 0;
+                while (bucket + 1 < BUCKETS && (std::int64_t(1) << (bucket + 1)) <= duration_ns) {
+                    bucket++;
+                }
+                return bucket;
+            }
+
+            static std::string bucket_label(const unsigned int bucket) {
+                const std::int64_t ns = std::int64_t(1) << bucket;
+                if (ns < 1000) {
+                    return std::to_string(ns) + "ns";
+                }
+                if (ns < 1000000) {
+                    return std::to_string(ns / 1000) + "us";
+                }
+                return std::to_string(ns / 1000000) + "ms";
+            }
+
+            void write_histograms(const std::vector<const ThreadBuffer*>& buffers) {
+                std::ofstream out(name + ".profile.txt", std::ios::trunc | std::ios::out);
+
+                std::array<std::array<std::uint64_t, BUCKETS>, PHASE_COUNT> buckets{};
+                std::array<std::uint64_t, PHASE_COUNT> calls{};
+                std::array<std::int64_t, PHASE_COUNT> total_ns{};
+                std::array<std::int64_t, PHASE_COUNT> max_ns{};
+                std::uint64_t dropped = 0;
+
+                for (const ThreadBuffer* buffer : buffers) {
+                    const std::size_t size = buffer->size();
+                    for (std::size_t i = 0; i < size; ++i) {
+                        const Event& event = buffer->at(i);
+                        const unsigned int phase = static_cast<unsigned int>(event.phase);
+                        buckets[phase][bucket_of(event.duration_ns)]++;
+                        calls[phase]++;
+                        total_ns[phase] += event.duration_ns;
+                        max_ns[phase] = std::max(max_ns[phase], event.duration_ns);
+                    }
+                    dropped += buffer->dropped.load(std::memory_order_relaxed);
+                }
+
+                out << std::fixed << std::setprecision(3);
+                out << "phase histograms over " << turn_starts_ns.size() << " turns on " << buffers.size()
+                    << " threads; " << dropped << " events dropped\n";
+                for (unsigned int phase = 0; phase < PHASE_COUNT; ++phase) {
+                    if (calls[phase] == 0) {
+                        continue;
+                    }
+                    out << "\n" << to_string(static_cast<Phase>(phase)) << ": " << calls[phase] << " calls, "
+                        << total_ns[phase] / 1e6 << "ms total, " << total_ns[phase] / 1e3 / calls[phase]
+                        << "us mean, " << max_ns[phase] / 1e3 << "us max\n";
+                    for (unsigned int bucket = 0; bucket < BUCKETS; ++bucket) {
+                        if (buckets[phase][bucket] > 0) {
+                            out << "  >= " << std::setw(6) << bucket_label(bucket) << ": " << buckets[phase][bucket] << "\n";
+                        }
+                    }
+                }
+
+                out << "\nturn";
+                for (unsigned int i = 0; i < COUNTER_COUNT; ++i) {
+                    out << " " << to_string(static_cast<Counter>(i));
+                }
+                out << "\n";
+                for (size_t turn = 0; turn + 1 < turn_counters.size(); ++turn) {
+                    out << turn;
+                    for (unsigned int i = 0; i < COUNTER_COUNT; ++i) {
+                        out << " " << turn_counters[turn + 1][i] - turn_counters[turn][i];
+                    }
+                    out << "\n";
+                }
+            }
+
+            void write_trace(const std::vector<const ThreadBuffer*>& buffers) {
+                std::ofstream out(name + ".trace.json", std::ios::trunc | std::ios::out);
+                out << std::fixed << std::setprecision(3);
+                out << "{\"traceEvents\":[\n";
+
+                bool first = true;
+                const auto separate = [&] {
+                    if (!first) {
+                        out << ",\n";
+                    }
+                    first = false;
+                };
+
+                for (const ThreadBuffer* buffer : buffers) {
+                    separate();
+                    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->thread_index
+                        << ",\"args\":{\"name\":\"thread " << buffer->thread_index << "\"}}";
+
+                    const std::size_t size = buffer->size();
+                    for (std::size_t i = 0; i < size; ++i) {
+                        const Event& event = buffer->at(i);
+                        separate();
+                        out << "{\"name\":\"" << to_string(event.phase) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":"
+                            << buffer->thread_index << ",\"ts\":" << event.start_ns / 1e3 << ",\"dur\":"
+                            << event.duration_ns / 1e3 << ",\"args\":{\"turn\":" << event.turn << "}}";
+                    }
+                }
+
+                // each turn's counts, drawn at the turn's start
+                for (size_t turn = 0; turn + 1 < turn_counters.size(); ++turn) {
+                    for (unsigned int i = 0; i < COUNTER_COUNT; ++i) {
+                        separate();
+                        out << "{\"name\":\"" << to_string(static_cast<Counter>(i)) << "\",\"ph\":\"C\",\"pid\":0,\"ts\":"
+                            << turn_starts_ns[turn] / 1e3 << ",\"args\":{\"calls\":"
+                            << turn_counters[turn + 1][i] - turn_counters[turn][i] << "}}";
+                    }
+                }
+
+                out << "\n]}\n";
+            }
+
+        public:
+            static Profiler& get() {
+                static Profiler instance{};
+                return instance;
+            }
+
+            /**
+             * The game ends by exiting, so the profile is written when the
+             * profiler is destroyed. The buffers are let go rather than freed,
+             * since a thread may still be recording while the process exits.
+             */
+            ~Profiler() {
+                if (!name.empty()) {
+                    write();
+                }
+                for (std::unique_ptr<ThreadBuffer>& thread : threads) {
+                    thread.release();
+                }
+            }
+
+            /// Files are written as <file_name>.profile.txt and <file_name>.trace.json.
+            void open(const std::string& file_name) {
+                name = file_name;
+            }
+
+            /// Called by the thread reading frames, as each one arrives.
+            void begin_turn(const int turn) {
+                turn_counters.push_back(counter_totals());
+                turn_starts_ns.push_back(now_ns());
+                current_turn = turn;
+            }
+
+            int turn() const {
+                return current_turn.load(std::memory_order_relaxed);
+            }
+
+            std::int64_t now_ns() const {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - started).count();
+            }
+
+            /// The calling thread's buffer, made the first time it asks.
+            ThreadBuffer& local() {
+                static thread_local ThreadBuffer* buffer = nullptr;
+                if (buffer == nullptr) {
+                    std::lock_guard<std::mutex> lock(threads_mutex);
+                    threads.emplace_back(new ThreadBuffer(threads.size()));
+                    buffer = threads.back().get();
+                }
+                return *buffer;
+            }
+
+            /// Reads what threads have published so far; threads may still be recording.
+            void write() {
+                // close off the turn in progress so its counts are written too
+                turn_counters.push_back(counter_totals());
+
+                std::vector<const ThreadBuffer*> buffers;
+                {
+                    std::lock_guard<std::mutex> lock(threads_mutex);
+                    for (const std::unique_ptr<ThreadBuffer>& thread : threads) {
+                        buffers.push_back(thread.get());
+                    }
+                }
+                write_histograms(buffers);
+                write_trace(buffers);
+            }
+        };
+
+        /// Whether timers keep track of the phase each thread is in, for the allocation tracker.
+        constexpr bool TRACKS_PHASES = constants::ENABLE_PROFILING || constants::ENABLE_ALLOCATION_TRACKING;
+
+        /**
+         * Times the enclosing scope as phase, or up to stop() if that comes
+         * first. While it runs, current_phase() on its thread is phase.
+         */
+        class ScopedTimer {
+        private:
+            const Phase phase;
+            std::int64_t start_ns = 0;
+            bool is_running = true;
+            unsigned int outer_phase = PHASE_COUNT;
+
+        public:
+            explicit ScopedTimer(const Phase phase) : phase(phase) {
+                if (TRACKS_PHASES) {
+                    outer_phase = current_phase();
+                    current_phase() = static_cast<unsigned int>(phase);
+                }
+                if (constants::ENABLE_PROFILING) {
+                    start_ns = Profiler::get().now_ns();
+                }
+            }
+
+            ~ScopedTimer() {
+                stop();
+            }
+
+            void stop() {
+                if (constants::ENABLE_PROFILING && is_running) {
+                    Profiler& profiler = Profiler::get();
+                    profiler.local().record({ phase, profiler.turn(), start_ns, profiler.now_ns() - start_ns });
+                }
+                if (TRACKS_PHASES && is_running) {
+                    current_phase() = outer_phase;
+                }
+                is_running = false;
+            }
+
+            /// The innermost phase being timed on the calling thread, or PHASE_COUNT outside any.
+            static unsigned int& current_phase() {
+                static thread_local unsigned int phase = PHASE_COUNT;
+                return phase;
+            }
+
+            ScopedTimer(const ScopedTimer&) = delete;
+            ScopedTimer& operator=(const ScopedTimer&) = delete;
+        };
+
+        static void count(const Counter counter, const std::uint64_t amount = 1) {
+            if (constants::ENABLE_PROFILING) {
+                Profiler::get().local().count(counter, amount);
+            }
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "map.hpp"
+
+namespace hlt {
+    namespace planning {
+        /// A box of the map and our ships inside it.
+        struct Region {
+            double min_x;
+            double min_y;
+            double max_x;
+            double max_y;
+            /// Fleet indices of our ships in the box.
+            std::vector<size_t> ships;
+
+            /// Whether location is in the box or within REGION_HALO of it.
+            bool reaches(const Location& location) const {
+                const double halo = constants::REGION_HALO;
+                return location.pos_x >= min_x - halo && location.pos_x <= max_x + halo &&
+                    location.pos_y >= min_y - halo && location.pos_y <= max_y + halo;
+            }
+        };
+
+        /// Halve region across its longer side at the median ship until no part has more than REGION_MAX_SHIPS.
+        static void split_region(const std::vector<Ship>& fleet, Region& region, std::vector<Region>& regions) {
+            if (region.ships.size() <= constants::REGION_MAX_SHIPS) {
+                regions.push_back(region);
+                return;
+            }
+
+            const bool across_x = region.max_x - region.min_x >= region.max_y - region.min_y;
+            const auto coordinate = [&](const size_t i) {
+                return across_x ? fleet[i].location.pos_x : fleet[i].location.pos_y;
+            };
+            std::sort(region.ships.begin(), region.ships.end(), [&](const size_t a, const size_t b) {
+                return coordinate(a) < coordinate(b) || (coordinate(a) == coordinate(b) && a < b);
+            });
+
+            const size_t median = region.ships.size() / 2;
+            const double cut = coordinate(region.ships[median]);
+
+            Region low = region;
+            Region high = region;
+            (across_x ? low.max_x : low.max_y) = cut;
+            (across_x ? high.min_x : high.min_y) = cut;
+            low.ships.assign(region.ships.begin(), region.ships.begin() + median);
+            high.ships.assign(region.ships.begin() + median, region.ships.end());
+
+            split_region(fleet, low, regions);
+            split_region(fleet, high, regions);
+        }
+
+        /**
+         * Split the map into boxes holding about the same number of our
+         * ships, so crowded fronts get small boxes and empty space big ones.
+         * Ships in each box keep their fleet order.
+         */
+        static std::vector<Region> partition_fleet(const Map& map, const PlayerId player_id) {
+            const std::vector<Ship>& fleet = map.ships.at(player_id);
+            Region whole = { 0, 0, (double) map.map_width, (double) map.map_height, {} };
+            for (size_t i = 0; i < fleet.size(); ++i) {
+                whole.ships.push_back(i);
+            }
+
+            std::vector<Region> regions;
+            split_region(fleet, whole, regions);
+            for (Region& region : regions) {
+                std::sort(region.ships.begin(), region.ships.end());
+            }
+            return regions;
+        }
+
+        /**
+         * Fill local with what ships in region can run into this turn: every
+         * planet, and every ship in the box or its halo. Returns the number
+         * of ships copied.
+         */
+        static unsigned int build_local_map(const Map& map, const Region& region, Map& local) {
+            local.map_width = map.map_width;
+            local.map_height = map.map_height;
+            local.planets = map.planets;
+            local.planet_map = map.planet_map;
+
+            local.ships.clear();
+            local.ship_map.clear();
+
+            unsigned int copied = 0;
+            for (const auto& player_ships : map.ships) {
+                std::vector<Ship>& ships = local.ships[player_ships.first];
+                entity_map<unsigned int>& ship_map = local.ship_map[player_ships.first];
+
+                for (const Ship& ship : player_ships.second) {
+                    if (region.reaches(ship.location)) {
+                        ship_map[ship.entity_id] = ships.size();
+                        ships.push_back(ship);
+                    }
+                }
+                copied += ships.size();
+            }
+            return copied;
+        }
+    }
+}
@@ -0,0 +1,411 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "fast_math.hpp"
+#include "navigation.hpp"
+#include "simulator.hpp"
+#include "thread_pool.hpp"
+
+namespace hlt {
+    namespace search {
+        /// What a whole group of ships does for the next few turns.
+        enum class MacroAction {
+            Hold = 0,
+            Attack,
+            Dock,
+            Retreat,
+        };
+
+        constexpr int MACRO_ACTIONS = 4;
+
+        struct ShipGroup {
+            std::vector<EntityId> ship_ids;
+            Location center;
+        };
+
+        struct SearchReport {
+            int candidates;
+            int rollouts;
+            int depth;
+            double elapsed_ms;
+            double best_score;
+
+            double rollouts_per_second() const {
+                return elapsed_ms > 0 ? rollouts * 1000.0 / elapsed_ms : 0;
+            }
+        };
+
+        /**
+         * Split our undocked ships into at most SEARCH_MAX_GROUPS groups of
+         * ships that are close together. Once the limit is hit, leftover ships
+         * join whichever group is nearest.
+         */
+        static std::vector<ShipGroup> group_ships(const Map& map, const PlayerId player_id) {
+            std::vector<ShipGroup> groups;
+
+            for (const Ship& ship : map.ships.at(player_id)) {
+                if (ship.docking_status != ShipDockingStatus::Undocked) {
+                    continue;
+                }
+
+                ShipGroup* nearest = nullptr;
+                double nearest_distance = 0;
+                for (ShipGroup& group : groups) {
+                    const double distance = group.center.get_distance_to(ship.location);
+                    if (nearest == nullptr || distance < nearest_distance) {
+                        nearest = &group;
+                        nearest_distance = distance;
+                    }
+                }
+
+                if (nearest == nullptr ||
+                    (nearest_distance > constants::SEARCH_GROUP_RADIUS && (int) groups.size() < constants::SEARCH_MAX_GROUPS)) {
+                    groups.push_back({ { ship.entity_id }, ship.location });
+                    continue;
+                }
+
+                // keep the center as the running mean of the members
+                const double members = nearest->ship_ids.size();
+                nearest->center.pos_x = (nearest->center.pos_x * members + ship.location.pos_x) / (members + 1);
+                nearest->center.pos_y = (nearest->center.pos_y * members + ship.location.pos_y) / (members + 1);
+                nearest->ship_ids.push_back(ship.entity_id);
+            }
+
+            return groups;
+        }
+
+        static int heading_between(const double from_x, const double from_y, const double to_x, const double to_y) {
+            return util::angle_rad_to_deg_clipped(fast_math::atan2(to_y - from_y, to_x - from_x));
+        }
+
+        static int nearest_enemy(const simulation::GameState& state, const simulation::SimShip& ship, const bool undocked_only, double& distance) {
+            int nearest = -1;
+            double nearest_distance2 = 0;
+            for (int j = 0; j < state.ship_count; ++j) {
+                const simulation::SimShip& other = state.ships[j];
+                if (!other.alive || other.owner_id == ship.owner_id ||
+                    (undocked_only && other.docking_status != ShipDockingStatus::Undocked)) {
+                    continue;
+                }
+                const double dx = other.pos_x - ship.pos_x;
+                const double dy = other.pos_y - ship.pos_y;
+                if (nearest == -1 || dx * dx + dy * dy < nearest_distance2) {
+                    nearest = j;
+                    nearest_distance2 = dx * dx + dy * dy;
+                }
+            }
+            distance = std::sqrt(nearest_distance2);
+            return nearest;
+        }
+
+        /// The command a ship following action gives this turn, inside a rollout.
+        static Move macro_move(const simulation::GameState& state, const int index, const MacroAction action) {
+            const simulation::SimShip& ship = state.ships[index];
+            if (ship.docking_status != ShipDockingStatus::Undocked) {
+                return Move::noop();
+            }
+
+            switch (action) {
+                case MacroAction::Hold:
+                    return Move::noop();
+
+                case MacroAction::Attack: {
+                    double distance;
+                    const int target = nearest_enemy(state, ship, false, distance);
+                    if (target < 0) {
+                        return Move::noop();
+                    }
+                    const int thrust = std::max(0, std::min(constants::MAX_SPEED, (int) (distance - constants::WEAPON_RADIUS + 1)));
+                    return Move::thrust(ship.entity_id, thrust,
+                                        heading_between(ship.pos_x, ship.pos_y, state.ships[target].pos_x, state.ships[target].pos_y));
+                }
+
+                case MacroAction::Retreat: {
+                    double distance;
+                    const int threat = nearest_enemy(state, ship, true, distance);
+                    if (threat < 0) {
+                        return Move::noop();
+                    }
+                    const int towards = heading_between(ship.pos_x, ship.pos_y, state.ships[threat].pos_x, state.ships[threat].pos_y);
+                    return Move::thrust(ship.entity_id, constants::MAX_SPEED, actions::wrap_angle(towards + 180));
+                }
+
+                case MacroAction::Dock: {
+                    int nearest = -1;
+                    double nearest_distance = 0;
+                    for (int p = 0; p < state.planet_count; ++p) {
+                        const simulation::SimPlanet& planet = state.planets[p];
+                        if (!planet.alive || (planet.owner_id >= 0 && planet.owner_id != ship.owner_id) ||
+                            planet.docked_count >= planet.docking_spots) {
+                            continue;
+                        }
+                        const double distance = std::hypot(planet.pos_x - ship.pos_x, planet.pos_y - ship.pos_y) - planet.radius;
+                        if (nearest == -1 || distance < nearest_distance) {
+                            nearest = p;
+                            nearest_distance = distance;
+                        }
+                    }
+
+                    if (nearest < 0) {
+                        return Move::noop();
+                    }
+
+                    const simulation::SimPlanet& planet = state.planets[nearest];
+                    if (nearest_distance <= constants::DOCK_RADIUS + constants::SHIP_RADIUS) {
+                        return Move::dock(ship.entity_id, planet.entity_id);
+                    }
+                    const int thrust = std::min(constants::MAX_SPEED, (int) (nearest_distance - constants::DOCK_RADIUS + 1));
+                    return Move::thrust(ship.entity_id, std::max(0, thrust),
+                                        heading_between(ship.pos_x, ship.pos_y, planet.pos_x, planet.pos_y));
+                }
+            }
+
+            return Move::noop();
+        }
+
+        /// How good a state is for player: our health and docked ships against everyone else's health.
+        static double evaluate(const simulation::GameState& state, const PlayerId player_id) {
+            double score = 0;
+            for (int i = 0; i < state.ship_count; ++i) {
+                const simulation::SimShip& ship = state.ships[i];
+                if (!ship.alive) {
+                    continue;
+                }
+                if (ship.owner_id != player_id) {
+                    score -= ship.health;
+                    continue;
+                }
+                score += ship.health;
+                if (ship.docking_status != ShipDockingStatus::Undocked) {
+                    score += constants::SEARCH_DOCKED_SHIP_VALUE;
+                }
+            }
+            return score;
+        }
+
+        /**
+         * Tries every combination of macro actions over our ship groups by
+         * rolling each out in the simulator, spread over the thread pool.
+         *
+         * All candidates are rolled out to one depth, then the depth goes up
+         * and they are all rolled out again, until the deadline. The best
+         * candidate of the deepest fully finished pass wins.
+         */
+        class RolloutSearch {
+        private:
+            ThreadPool& pool;
+            simulation::GameState root;
+            std::vector<std::unique_ptr<simulation::GameState>> scratch;
+
+            /// Group of every ship in root, by ship index; -1 for ships not in a group.
+            std::vector<int> group_of;
+
+            double rollout(simulation::GameState& state, const PlayerId player_id, const int candidate, const int depth) const {
+                state.copy_from(root);
+
+                for (int turn = 0; turn < depth; ++turn) {
+                    state.begin_commands();
+
+                    for (int i = 0; i < state.ship_count; ++i) {
+                        const simulation::SimShip& ship = state.ships[i];
+                        if (!ship.alive) {
+                            continue;
+                        }
+
+                        MacroAction action = MacroAction::Attack;
+                        if (ship.owner_id == player_id) {
+                            const int group = i < (int) group_of.size() ? group_of[i] : -1;
+                            action = group < 0 ? MacroAction::Dock : action_of(candidate, group);
+                        }
+
+                        state.apply_move(ship.owner_id, macro_move(state, i, action));
+                    }
+
+                    state.step();
+                }
+
+                return evaluate(state, player_id);
+            }
+
+        public:
+            explicit RolloutSearch(ThreadPool& thread_pool) : pool(thread_pool) {
+                for (unsigned int i = 0; i < pool.size(); ++i) {
+                    scratch.emplace_back(new simulation::GameState());
+                }
+            }
+
+            static MacroAction action_of(int candidate, const int group) {
+                for (int g = 0; g < group; ++g) {
+                    candidate /= MACRO_ACTIONS;
+                }
+                return static_cast<MacroAction>(candidate % MACRO_ACTIONS);
+            }
+
+            /**
+             * Returns the winning candidate of the deepest pass every candidate
+             * finished; decode it per group with action_of(). If not even the
+             * first pass finished there is no plan, and the groups should be
+             * planned the usual way.
+             */
+            possibly<int> search(
+                    const Map& map,
+                    const PlayerId player_id,
+                    const std::vector<ShipGroup>& groups,
+                    const double budget_ms,
+                    SearchReport& report)
+            {
+                typedef std::chrono::steady_clock clock;
+                const clock::time_point start = clock::now();
+                const clock::time_point deadline = start + std::chrono::microseconds((long long) (budget_ms * 1000));
+
+                root.load(map);
+                group_of.assign(root.ship_count, -1);
+                for (size_t g = 0; g < groups.size(); ++g) {
+                    for (const EntityId ship_id : groups[g].ship_ids) {
+                        const int index = root.ship_index(player_id, ship_id);
+                        if (index >= 0) {
+                            group_of[index] = g;
+                        }
+                    }
+                }
+
+                int candidates = 1;
+                for (size_t g = 0; g < groups.size(); ++g) {
+                    candidates *= MACRO_ACTIONS;
+                }
+
+                std::vector<double> scores(candidates);
+                int best = 0;
+                double best_score = -std::numeric_limits<double>::max();
+                report = { candidates, 0, 0, 0, best_score };
+
+                for (int depth = constants::SEARCH_MIN_DEPTH; depth <= constants::SEARCH_MAX_DEPTH; ++depth) {
+                    std::fill(scores.begin(), scores.end(), -std::numeric_limits<double>::max());
+                    std::atomic<int> finished(0);
+
+                    TaskGroup rollouts;
+                    for (int candidate = 0; candidate < candidates; ++candidate) {
+                        pool.run(rollouts, [&, candidate, depth] {
+                            if (clock::now() >= deadline) {
+                                return;
+                            }
+                            scores[candidate] = rollout(*scratch[pool.worker_index()], player_id, candidate, depth);
+                            finished++;
+                        });
+                    }
+                    pool.wait(rollouts);
+
+                    report.rollouts += finished;
+                    if (finished != candidates) {
+                        // a half finished pass only scored whichever candidates happened to run
+                        break;
+                    }
+
+                    best_score = -std::numeric_limits<double>::max();
+                    for (int c = 0; c < candidates; ++c) {
+                        if (scores[c] > best_score) {
+                            best_score = scores[c];
+                            best = c;
+                        }
+                    }
+                    report.depth = depth;
+                    report.best_score = best_score;
+                }
+
+                report.elapsed_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+                return { best, report.depth > 0 };
+            }
+        };
+
+        /**
+         * Turn the winning candidate into real moves for every grouped ship,
+         * going through the normal navigation. Returns the ships that got a
+         * move; any ship left out should be planned the usual way.
+         */
+        static std::unordered_set<EntityId> commit(
+                Map& map,
+                const PlayerId player_id,
+                const std::vector<ShipGroup>& groups,
+                const int candidate,
+                std::vector<Move>& moves)
+        {
+            std::unordered_set<EntityId> planned;
+
+            for (size_t g = 0; g < groups.size(); ++g) {
+                const MacroAction action = RolloutSearch::action_of(candidate, g);
+
+                for (const EntityId ship_id : groups[g].ship_ids) {
+                    Ship& ship = map.get_ship(player_id, ship_id);
+                    ship.sort_nearby_entitys();
+
+                    possibly<Move> move = { Move::noop(), false };
+                    switch (action) {
+                        case MacroAction::Hold:
+                            move = { Move::noop(), true };
+                            break;
+
+                        case MacroAction::Attack: {
+                            if (ship.nearby_enemy_ships.empty()) {
+                                break;
+                            }
+                            const NearbyEntity& entity = ship.nearby_enemy_ships[0];
+                            const Ship& target = map.get_ship(entity.owner_id, entity.entity_id);
+                            const Location target_location = ship.location.get_closest_point(
+                                    target.location, constants::WEAPON_RADIUS - 1);
+                            move = navigation::navigate_ship_towards_target(
+                                    map, ship, target_location, constants::MAX_SPEED, true,
+                                    constants::MAX_NAVIGATION_CORRECTIONS, M_PI / 180.0);
+                            break;
+                        }
+
+                        case MacroAction::Retreat: {
+                            if (ship.nearby_enemy_ships.empty()) {
+                                break;
+                            }
+                            const NearbyEntity& entity = ship.nearby_enemy_ships[0];
+                            const Ship& threat = map.get_ship(entity.owner_id, entity.entity_id);
+                            const int away = actions::wrap_angle(ship.location.orient_towards_in_deg(threat.location) + 180);
+                            const Location target_location = actions::displaced(ship.location, constants::MAX_SPEED, away);
+                            move = navigation::navigate_ship_towards_target(
+                                    map, ship, target_location, constants::MAX_SPEED, true,
+                                    constants::MAX_NAVIGATION_CORRECTIONS, M_PI / 180.0);
+                            break;
+                        }
+
+                        case MacroAction::Dock: {
+                            for (const NearbyEntity& entity : ship.nearby_planets) {
+                                Planet& planet = map.get_planet(entity.entity_id);
+                                if ((planet.is_owned && !planet.is_owned_by(player_id)) ||
+                                    docking::DockingSlots::get().is_full(planet, ship)) {
+                                    continue;
+                                }
+
+                                if (ship.can_dock(planet)) {
+                                    docking::DockingSlots::get().reserve(planet, ship);
+                                    move = { Move::dock(ship.entity_id, planet.entity_id), true };
+                                } else {
+                                    move = navigation::navigate_ship_to_dock(map, ship, planet, constants::MAX_SPEED);
+                                }
+                                break;
+                            }
+                            break;
+                        }
+                    }
+
+                    if (move.second) {
+                        moves.push_back(move.first);
+                        planned.insert(ship_id);
+                    }
+                }
+            }
+
+            return planned;
+        }
+    }
+}
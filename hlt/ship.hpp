@@ -14,9 +14,6 @@ namespace hlt {
     };
 
     struct Ship : Entity {
-        // list of own ships that are focusing on this ship
-        std::vector<NearbyEntity> ships_moving_towards;
-
         /// The turns left before the ship can fire again.
         int weapon_cooldown;
 
@@ -29,6 +26,11 @@ namespace hlt {
         /// Ship::docking_status is -not- DockingStatus::Undocked.
         EntityId docked_planet;
 
+        /// Set when navigation left this ship's heading to the local avoidance
+        /// pass, which steers it towards avoidance_target.
+        bool needs_local_avoidance = false;
+        Location avoidance_target;
+
         /// Check if this ship is close enough to dock to the given planet.
         bool can_dock(const Planet& planet) const {
             return location.get_distance_to(planet.location) <= (constants::SHIP_RADIUS + constants::DOCK_RADIUS + planet.radius);
@@ -1,6 +1,20 @@
+#pragma once
+
+#include <vector>
+
+#include "action_space.hpp"
+#include "docking_slots.hpp"
+#include "engagement.hpp"
+#include "influence_map.hpp"
+#include "log.hpp"
+#include "navigation.hpp"
+#include "profiling.hpp"
+#include "threat_table.hpp"
+#include "turn_clock.hpp"
+
 namespace hlt {
     namespace combat {
-        int get_closest_corner(
+        static int get_closest_corner(
             Map& map,
             Ship& ship
         ) {
@@ -26,38 +40,6 @@ namespace hlt {
             return ship.location.orient_towards_in_deg(closest_point);
         }
 
-        int get_target_danger(
-            Map& map,
-            Ship& ship,
-            Location target
-        ) {
-            const double target_radius = constants::MAX_SPEED + ship.radius +
-                ship.radius + constants::WEAPON_RADIUS;
-            int danger = 0;
-
-            if (collision::out_of_bounds(map, target)) {
-                return 9999;
-            }
-
-            for (const auto& player_ship : map.ships) {
-                for (const Ship& ship2 : player_ship.second) {
-                    if (ship.owner_id == ship2.owner_id) {
-                        continue;
-                    }
-                    if (ship2.docking_status != ShipDockingStatus::Undocked) {
-                        continue;
-                    }
-
-                    const double distance = target.distance(ship2.location);
-                    if (distance <= target_radius) {
-                        danger++;
-                    }
-                }
-            }
-
-            return danger;
-        }
-
         static void handle_abandonment(
             Map& map,
             std::vector<hlt::Move>& moves,
@@ -75,24 +57,15 @@ namespace hlt {
             }
 
             // the best course of action is to run when we have no docked ships left
-            int working_angle = get_closest_corner(map, ship);
+            const int working_angle = get_closest_corner(map, ship);
+            const InfluenceMap& influence = InfluenceMap::get();
 
-            Location best_target = { 0, 0 };
-            int lowest_danger_level = 9999;
-
-            for (int angle_deg = 0; angle_deg < max_corrections; angle_deg++) {
-                working_angle = hlt::navigation::clip_angle(working_angle + 1);
-
-                const double new_target_dx = 7 * std::cos(working_angle * M_PI / 180.0);
-                const double new_target_dy = 7 * std::sin(working_angle * M_PI / 180.0);
-                const Location new_target = { ship.location.pos_x + new_target_dx, ship.location.pos_y + new_target_dy };
-
-                int danger = get_target_danger(map, ship, new_target);
-                if (danger < lowest_danger_level) {
-                    lowest_danger_level = danger;
-                    best_target = new_target;
-                }
-            }
+            const int corrections = timing::TurnClock::get().scaled(max_corrections, constants::TURN_MIN_CORRECTIONS);
+            const possibly<actions::Action> safest = actions::best_action(
+                ship.location, constants::MAX_SPEED, constants::MAX_SPEED, working_angle + 1, corrections,
+                [&](const Location& destination) { return influence.danger_at(map, destination); },
+                9999);
+            const Location best_target = safest.second ? safest.first.destination : Location{ 0, 0 };
 
             hlt::possibly<hlt::Move> move =
                 hlt::navigation::navigate_ship_towards_target(
@@ -147,7 +120,6 @@ namespace hlt {
                             hlt::constants::MAX_SPEED,
                             true, 90, M_PI / 180.0);
                     if (move.second) {
-                        map.add_moving_towards(closest_enemy_ship, ship);
                         moves.push_back(move.first);
                         break;
                     }
@@ -165,11 +137,11 @@ namespace hlt {
 
                         // we might want to move towards our ships to group them together
                         double angle_away_from_target = ship.location.orient_towards_in_deg(closest_enemy_ship.location) + 180;
-                        angle_away_from_target = angle_away_from_target * 180.0 / M_PI;
+                        angle_away_from_target = angle_away_from_target * M_PI / 180.0;
 
                         const hlt::Location& target_location = { 
-                            ship.location.pos_x + ((target_radius - distance) * cos(angle_away_from_target)),
-                            ship.location.pos_y + ((target_radius - distance) * sin(angle_away_from_target))
+                            ship.location.pos_x + ((target_radius - distance) * fast_math::cos(angle_away_from_target)),
+                            ship.location.pos_y + ((target_radius - distance) * fast_math::sin(angle_away_from_target))
                          };
 
                         hlt::possibly<hlt::Move> move =
@@ -180,7 +152,6 @@ namespace hlt {
                                 hlt::constants::MAX_SPEED,
                                 true, 90, M_PI / 180.0);
                         if (move.second) {
-                            map.add_moving_towards(closest_enemy_ship, ship);
                             moves.push_back(move.first);
                             break;
                         }
@@ -200,7 +171,6 @@ namespace hlt {
                                 hlt::constants::MAX_SPEED,
                                 true, 90, M_PI / 180.0);
                         if (move.second) {
-                            map.add_moving_towards(closest_enemy_ship, ship);
                             moves.push_back(move.first);
                             break;
                         }
@@ -209,34 +179,24 @@ namespace hlt {
             }
         }
 
-        Location get_safe_location(
+        static Location get_safe_location(
             Map& map,
             Ship& ship,
             Location target_location
         ) {
-            int working_angle = ship.location.orient_towards_in_deg(target_location);
+            const int working_angle = ship.location.orient_towards_in_deg(target_location);
+            const InfluenceMap& influence = InfluenceMap::get();
 
-            Location best_target = { 0, 0 };
-            int lowest_danger_level = 9999;
+            const int corrections = timing::TurnClock::get().scaled(360, constants::TURN_MIN_CORRECTIONS);
+            const possibly<actions::Action> safest = actions::best_action(
+                ship.location, constants::MAX_SPEED, constants::MAX_SPEED, working_angle + 1, corrections,
+                [&](const Location& destination) { return influence.danger_at(map, destination); },
+                9999);
 
-            for (int angle_deg = 0; angle_deg < 360; angle_deg++) {
-                working_angle = hlt::navigation::clip_angle(working_angle + 1);
-
-                const double new_target_dx = 7 * std::cos(working_angle * M_PI / 180.0);
-                const double new_target_dy = 7 * std::sin(working_angle * M_PI / 180.0);
-                const Location new_target = { ship.location.pos_x + new_target_dx, ship.location.pos_y + new_target_dy };
-
-                int danger = get_target_danger(map, ship, new_target);
-                if (danger < lowest_danger_level) {
-                    lowest_danger_level = danger;
-                    best_target = new_target;
-                }
-            }
-
-            return best_target;
+            return safest.second ? safest.first.destination : Location{ 0, 0 };
         }
 
-        Ship get_closest_ship(
+        static Ship get_closest_ship(
             Map& map,
             Ship& ship,
             std::vector<NearbyEntity> entity_list
@@ -264,6 +224,8 @@ namespace hlt {
             Ship& ship,
             NearbyEntity& entity
         ) {
+            const profiling::ScopedTimer timer(profiling::Phase::HandleShip);
+
             // planet docking and navigation logic
             if (!entity.is_ship) {
                 // get the planet from the map
@@ -285,16 +247,16 @@ namespace hlt {
                     return false;
                 }
 
-                // check if the planet is full
-                const int already_moving_towards = planet.ships_moving_towards.size();
-                if (planet.is_owned_by(player_id) && (planet.docked_ships.size() + already_moving_towards) >= planet.docking_spots) {
+                // check if the planet is full, counting ships that have claimed a docking slot
+                docking::DockingSlots& docking_slots = docking::DockingSlots::get();
+                if (docking_slots.is_full(planet, ship)) {
                     // planet full!
                     return false;
                 }
 
                 if (ship.can_dock(planet)) {
                     // before docking we should check if its safe to do so
-                    map.add_moving_towards(planet, ship);
+                    docking_slots.reserve(planet, ship);
                     moves.push_back(hlt::Move::dock(ship.entity_id, planet.entity_id));
                     return true;
                 }
@@ -302,7 +264,6 @@ namespace hlt {
                 hlt::possibly<hlt::Move> move =
                         hlt::navigation::navigate_ship_to_dock(map, ship, planet, hlt::constants::MAX_SPEED);
                 if (move.second) {
-                    map.add_moving_towards(planet, ship);
                     moves.push_back(move.first);
                     return true;
                 }
@@ -337,7 +298,6 @@ namespace hlt {
                             hlt::constants::MAX_SPEED,
                             true, 90, M_PI / 180.0);
                     if (move.second) {
-                        map.add_moving_towards(target_ship, ship);
                         moves.push_back(move.first);
                         return true;
                     }
@@ -368,7 +328,6 @@ namespace hlt {
                                 hlt::constants::MAX_SPEED,
                                 true, 90, M_PI / 180.0);
                         if (move.second) {
-                            map.add_moving_towards(target_ship, ship);
                             moves.push_back(move.first);
                             return true;
                         }
@@ -381,19 +340,21 @@ namespace hlt {
                 hlt::Location target_location = ship.location.get_closest_point(target_ship.location,
                     target_radius);
 
-                if (entity.distance < max_distance && ship.nearby_owned_and_docked_ships.size() > 0) {
-                    auto nearby_docked = ship.nearby_owned_and_docked_ships[0];
-                    hlt::Ship& nearby_docked_ship = map.get_ship(nearby_docked.owner_id, nearby_docked.entity_id);
-
+                const Threat* threat = ThreatTable::get().defended_by(ship.entity_id);
+                if (entity.distance < max_distance && threat != nullptr) {
+                    // stand between the docked ship we are first to reach and whoever is coming for it
+                    const hlt::Ship& attacker = map.get_ship(threat->attacker_owner, threat->attacker_id);
                     const double defense_target_radius = hlt::constants::WEAPON_RADIUS - 1;
-                    const double angle_towards_enemy = ship.location.orient_towards_in_deg(target_ship.location);
+                    const int angle_towards_enemy = threat->location.orient_towards_in_deg(attacker.location);
 
-                    const double new_target_dx = defense_target_radius * std::cos(angle_towards_enemy * M_PI / 180.0);
-                    const double new_target_dy = defense_target_radius * std::sin(angle_towards_enemy * M_PI / 180.0);
-                    Location defense_target_location = { nearby_docked_ship.location.pos_x + new_target_dx,
-                        nearby_docked_ship.location.pos_y + new_target_dy };
+                    const Location towards_enemy = actions::unit_vector(angle_towards_enemy);
+                    const double new_target_dx = defense_target_radius * towards_enemy.pos_x;
+                    const double new_target_dy = defense_target_radius * towards_enemy.pos_y;
+                    Location defense_target_location = { threat->location.pos_x + new_target_dx,
+                        threat->location.pos_y + new_target_dy };
 
-                    if (nearby_docked.distance < (max_distance * 1.5)) {
+                    if (threat->location.get_distance_to(ship.location) < (max_distance * 1.5) &&
+                        threat->contact_turns <= constants::THREAT_DEFEND_TURNS) {
                         hlt::Log::log("DOCKED AND DEFENDING");
 
                         hlt::possibly<hlt::Move> move =
@@ -404,7 +365,6 @@ namespace hlt {
                                 hlt::constants::MAX_SPEED,
                                 true, 90, M_PI / 180.0);
                         if (move.second) {
-                            map.add_moving_towards(target_ship, ship);
                             moves.push_back(move.first);
                             return true;
                         }
@@ -414,6 +374,21 @@ namespace hlt {
                 if (entity.distance < max_distance) {
                     // target_location = get_safe_location(map, ship, target_location);
                 }
+
+                if (target_ship.docking_status == hlt::ShipDockingStatus::Undocked &&
+                    entity.distance <= constants::ENGAGEMENT_RADIUS) {
+                    // don't throw ourselves into a fight we can't win
+                    Engagement fight;
+                    fight.add_around(map, target_ship.location, constants::ENGAGEMENT_RADIUS);
+                    if (target_ship.location.get_distance_to(ship.location) > constants::ENGAGEMENT_RADIUS) {
+                        fight.add(ship);
+                    }
+
+                    const EngagementOutcome outcome = fight.simulate(constants::ENGAGEMENT_TURNS);
+                    if (outcome.survivors[player_id] == 0 && outcome.survivors[target_ship.owner_id] > 0) {
+                        return false;
+                    }
+                }
                 
                 hlt::possibly<hlt::Move> move =
                     hlt::navigation::navigate_ship_towards_target(
@@ -423,7 +398,6 @@ namespace hlt {
                         hlt::constants::MAX_SPEED,
                         true, 90, M_PI / 180.0);
                 if (move.second) {
-                    map.add_moving_towards(target_ship, ship);
                     moves.push_back(move.first);
                     return true;
                 }
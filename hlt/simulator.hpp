@@ -0,0 +1,721 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "action_space.hpp"
+#include "collision.hpp"
+#include "map.hpp"
+#include "move.hpp"
+
+namespace hlt {
+    namespace simulation {
+        constexpr int MAX_SHIPS = 1024;
+        constexpr int MAX_PLANETS = 64;
+        constexpr int MAX_DOCKED = 16;
+        constexpr int MAX_EVENTS = 16384;
+
+        struct SimShip {
+            EntityId entity_id;
+            PlayerId owner_id;
+            double pos_x, pos_y;
+            double vel_x, vel_y;
+            int health;
+            int weapon_cooldown;
+            ShipDockingStatus docking_status;
+            int docking_progress;
+
+            /// Index into GameState::planets, -1 while undocked.
+            int planet;
+            bool alive;
+        };
+
+        struct SimPlanet {
+            EntityId entity_id;
+            double pos_x, pos_y;
+            double radius;
+            int health;
+            int docking_spots;
+            int current_production;
+            int remaining_production;
+            PlayerId owner_id;
+            bool alive;
+
+            int docked_count;
+            /// Indices into GameState::ships.
+            int docked[MAX_DOCKED];
+        };
+
+        enum class EventType {
+            Collision = 0,
+            Attack = 1,
+        };
+
+        /// Something that happens to a pair of entities part way through a turn.
+        struct Event {
+            long time;
+            EventType type;
+            int first;
+            /// A ship index, or -1 - planet index for planets.
+            int second;
+
+            bool operator<(const Event& other) const {
+                if (time != other.time) {
+                    return time < other.time;
+                }
+                return type < other.type;
+            }
+        };
+
+        /**
+         * Everything the engine tracks, laid out in fixed arrays so a turn can
+         * be simulated without touching the heap.
+         *
+         * step() follows the engine's turn order: weapon cooldowns, commands,
+         * collision and attack events in time order (rounded to
+         * EVENT_TIME_PRECISION), movement, docking progress, and production
+         * and spawning. A planet rammed down to no health explodes right
+         * there among the events, so the ships it takes with it play no
+         * further part in the turn.
+         */
+        class GameState {
+        private:
+            Event events[MAX_EVENTS];
+            int event_count = 0;
+            int damage[MAX_SHIPS];
+            bool dock_requested[MAX_SHIPS];
+            bool dock_contested[MAX_PLANETS];
+            PlayerId dock_claimant[MAX_PLANETS];
+
+            static double attack_range() {
+                return constants::WEAPON_RADIUS + 2 * constants::SHIP_RADIUS;
+            }
+
+            void add_event(const double time, const EventType type, const int first, const int second) {
+                if (event_count < MAX_EVENTS) {
+                    events[event_count++] = { std::lround(time * EVENT_TIME_PRECISION), type, first, second };
+                }
+            }
+
+            /**
+             * First time in [0, 1] two moving circles come within distance r of
+             * each other, or a negative number if they never do this turn.
+             */
+            static double first_contact(
+                    const double dx, const double dy, const double dvx, const double dvy, const double r)
+            {
+                const double c = dx * dx + dy * dy - r * r;
+                if (c <= 0) {
+                    return 0;
+                }
+
+                const double a = dvx * dvx + dvy * dvy;
+                const double b = 2 * (dx * dvx + dy * dvy);
+                if (a == 0 || b >= 0) {
+                    return -1;
+                }
+
+                const double disc = b * b - 4 * a * c;
+                if (disc < 0) {
+                    return -1;
+                }
+
+                const double t = (-b - std::sqrt(disc)) / (2 * a);
+                return t <= 1 ? t : -1;
+            }
+
+            void position_at(const SimShip& ship, const double t, double& x, double& y) const {
+                x = ship.pos_x + ship.vel_x * t;
+                y = ship.pos_y + ship.vel_y * t;
+            }
+
+            void detach_from_planet(const int index) {
+                SimShip& ship = ships[index];
+                if (ship.planet < 0) {
+                    return;
+                }
+
+                SimPlanet& planet = planets[ship.planet];
+                for (int i = 0; i < planet.docked_count; ++i) {
+                    if (planet.docked[i] == index) {
+                        planet.docked[i] = planet.docked[--planet.docked_count];
+                        break;
+                    }
+                }
+                if (planet.docked_count == 0) {
+                    planet.owner_id = -1;
+                }
+                ship.planet = -1;
+            }
+
+            void kill_ship(const int index) {
+                SimShip& ship = ships[index];
+                if (!ship.alive) {
+                    return;
+                }
+                ship.alive = false;
+                ship.health = 0;
+                detach_from_planet(index);
+            }
+
+            void damage_ship(const int index, const int amount) {
+                ships[index].health -= amount;
+                if (ships[index].health <= 0) {
+                    kill_ship(index);
+                }
+            }
+
+            void find_events() {
+                event_count = 0;
+                const double reach = 2 * constants::MAX_SPEED + attack_range() + 1;
+
+                for (int i = 0; i < ship_count; ++i) {
+                    const SimShip& ship = ships[i];
+                    if (!ship.alive) {
+                        continue;
+                    }
+
+                    for (int j = i + 1; j < ship_count; ++j) {
+                        const SimShip& other = ships[j];
+                        if (!other.alive) {
+                            continue;
+                        }
+
+                        const double dx = ship.pos_x - other.pos_x;
+                        const double dy = ship.pos_y - other.pos_y;
+                        if (std::fabs(dx) > reach || std::fabs(dy) > reach) {
+                            continue;
+                        }
+
+                        const double dvx = ship.vel_x - other.vel_x;
+                        const double dvy = ship.vel_y - other.vel_y;
+
+                        const double collision_time = first_contact(dx, dy, dvx, dvy, 2 * constants::SHIP_RADIUS);
+                        if (collision_time >= 0) {
+                            add_event(collision_time, EventType::Collision, i, j);
+                        }
+
+                        if (ship.owner_id != other.owner_id) {
+                            const double attack_time = first_contact(dx, dy, dvx, dvy, attack_range());
+                            if (attack_time >= 0) {
+                                add_event(attack_time, EventType::Attack, i, j);
+                            }
+                        }
+                    }
+
+                    for (int p = 0; p < planet_count; ++p) {
+                        const SimPlanet& planet = planets[p];
+                        if (!planet.alive || ship.planet == p) {
+                            continue;
+                        }
+
+                        const double t = first_contact(
+                                ship.pos_x - planet.pos_x, ship.pos_y - planet.pos_y,
+                                ship.vel_x, ship.vel_y, planet.radius + constants::SHIP_RADIUS);
+                        if (t >= 0) {
+                            add_event(t, EventType::Collision, i, -1 - p);
+                        }
+                    }
+                }
+
+                std::sort(events, events + event_count);
+            }
+
+            /// Blow up planet p at time t, destroying its docked ships and damaging those nearby.
+            void explode_planet(const int p, const double t) {
+                SimPlanet& planet = planets[p];
+                planet.alive = false;
+                while (planet.docked_count > 0) {
+                    kill_ship(planet.docked[0]);
+                }
+
+                for (int i = 0; i < ship_count; ++i) {
+                    if (!ships[i].alive) {
+                        continue;
+                    }
+                    double x, y;
+                    position_at(ships[i], t, x, y);
+                    const double surface_distance = std::hypot(x - planet.pos_x, y - planet.pos_y) - planet.radius;
+                    if (surface_distance <= constants::EXPLOSION_RADIUS) {
+                        const double falloff = std::max(0.0, surface_distance) / constants::EXPLOSION_RADIUS;
+                        damage_ship(i, (int) (constants::MAX_SHIP_HEALTH * (1 - falloff)));
+                    }
+                }
+            }
+
+            void process_collision(const Event& event) {
+                SimShip& ship = ships[event.first];
+                if (!ship.alive) {
+                    return;
+                }
+
+                if (event.second < 0) {
+                    SimPlanet& planet = planets[-1 - event.second];
+                    if (!planet.alive) {
+                        return;
+                    }
+                    planet.health -= ship.health;
+                    kill_ship(event.first);
+                    if (planet.health <= 0) {
+                        explode_planet(-1 - event.second, (double) event.time / EVENT_TIME_PRECISION);
+                    }
+                    return;
+                }
+
+                SimShip& other = ships[event.second];
+                if (!other.alive) {
+                    return;
+                }
+                const int ship_health = ship.health;
+                damage_ship(event.first, other.health);
+                damage_ship(event.second, ship_health);
+            }
+
+            /// Every ship that is ready fires at everything in range at time t, all at once.
+            void process_attacks(const int first_event, const int end_event) {
+                const double t = (double) events[first_event].time / EVENT_TIME_PRECISION;
+                const double range2 = attack_range() * attack_range();
+
+                for (int e = first_event; e < end_event; ++e) {
+                    const int attackers[2] = { events[e].first, events[e].second };
+                    for (const int attacker : attackers) {
+                        SimShip& ship = ships[attacker];
+                        if (!ship.alive || ship.weapon_cooldown > 0 ||
+                            ship.docking_status != ShipDockingStatus::Undocked) {
+                            continue;
+                        }
+
+                        double x, y;
+                        position_at(ship, t, x, y);
+
+                        int targets[MAX_SHIPS];
+                        int target_count = 0;
+                        for (int j = 0; j < ship_count; ++j) {
+                            const SimShip& other = ships[j];
+                            if (!other.alive || other.owner_id == ship.owner_id) {
+                                continue;
+                            }
+                            double ox, oy;
+                            position_at(other, t, ox, oy);
+                            if ((ox - x) * (ox - x) + (oy - y) * (oy - y) <= range2) {
+                                targets[target_count++] = j;
+                            }
+                        }
+
+                        if (target_count == 0) {
+                            continue;
+                        }
+
+                        for (int k = 0; k < target_count; ++k) {
+                            damage[targets[k]] += constants::WEAPON_DAMAGE / target_count;
+                        }
+                        ship.weapon_cooldown = constants::WEAPON_COOLDOWN;
+                    }
+                }
+
+                for (int j = 0; j < ship_count; ++j) {
+                    if (ships[j].alive && damage[j] > 0) {
+                        damage_ship(j, damage[j]);
+                    }
+                    damage[j] = 0;
+                }
+            }
+
+            void process_events() {
+                std::fill(damage, damage + ship_count, 0);
+
+                int e = 0;
+                while (e < event_count) {
+                    const long time = events[e].time;
+                    int end = e;
+                    while (end < event_count && events[end].time == time && events[end].type == EventType::Collision) {
+                        process_collision(events[end]);
+                        end++;
+                    }
+
+                    int attack_end = end;
+                    while (attack_end < event_count && events[attack_end].time == time) {
+                        attack_end++;
+                    }
+                    if (attack_end > end) {
+                        process_attacks(end, attack_end);
+                    }
+
+                    e = attack_end;
+                }
+            }
+
+            void process_movement() {
+                for (int i = 0; i < ship_count; ++i) {
+                    SimShip& ship = ships[i];
+                    if (!ship.alive) {
+                        continue;
+                    }
+
+                    ship.pos_x += ship.vel_x;
+                    ship.pos_y += ship.vel_y;
+                    ship.vel_x = 0;
+                    ship.vel_y = 0;
+
+                    if (ship.pos_x < 0 || ship.pos_y < 0 || ship.pos_x >= map_width || ship.pos_y >= map_height) {
+                        // deserters are destroyed
+                        kill_ship(i);
+                    }
+                }
+            }
+
+            void process_docking() {
+                for (int i = 0; i < ship_count; ++i) {
+                    SimShip& ship = ships[i];
+                    if (!ship.alive || ship.docking_status == ShipDockingStatus::Undocked ||
+                        ship.docking_status == ShipDockingStatus::Docked) {
+                        continue;
+                    }
+
+                    if (--ship.docking_progress > 0) {
+                        continue;
+                    }
+
+                    if (ship.docking_status == ShipDockingStatus::Docking) {
+                        ship.docking_status = ShipDockingStatus::Docked;
+                    } else {
+                        ship.docking_status = ShipDockingStatus::Undocked;
+                        detach_from_planet(i);
+                    }
+                }
+            }
+
+            void spawn_ship(SimPlanet& planet) {
+                if (ship_count >= MAX_SHIPS) {
+                    return;
+                }
+
+                // the engine spawns on the side of the planet facing the middle of the map
+                const double to_center = std::atan2(map_height / 2.0 - planet.pos_y, map_width / 2.0 - planet.pos_x);
+                const double distance = planet.radius + constants::SPAWN_RADIUS;
+                const int base_angle = (int) std::lround(to_center * 180.0 / M_PI);
+
+                // fan out from there in alternating 10 degree steps until there is room
+                for (int k = 0; k < actions::HEADINGS / 10; ++k) {
+                    const int angle = base_angle + ((k + 1) / 2) * (k % 2 == 0 ? -10 : 10);
+                    const Location direction = actions::unit_vector(angle);
+                    const double x = planet.pos_x + direction.pos_x * distance;
+                    const double y = planet.pos_y + direction.pos_y * distance;
+
+                    bool occupied = x < 0 || y < 0 || x >= map_width || y >= map_height;
+                    for (int i = 0; i < ship_count && !occupied; ++i) {
+                        const double dx = ships[i].pos_x - x;
+                        const double dy = ships[i].pos_y - y;
+                        occupied = ships[i].alive && dx * dx + dy * dy < 4 * constants::SHIP_RADIUS * constants::SHIP_RADIUS;
+                    }
+                    if (occupied) {
+                        continue;
+                    }
+
+                    SimShip& ship = ships[ship_count++];
+                    ship = { next_ship_id++, planet.owner_id, x, y, 0, 0, constants::BASE_SHIP_HEALTH, 0,
+                             ShipDockingStatus::Undocked, 0, -1, true };
+                    return;
+                }
+            }
+
+            void process_production() {
+                for (int p = 0; p < planet_count; ++p) {
+                    SimPlanet& planet = planets[p];
+                    if (!planet.alive || planet.owner_id < 0) {
+                        continue;
+                    }
+
+                    int docked = 0;
+                    for (int i = 0; i < planet.docked_count; ++i) {
+                        docked += ships[planet.docked[i]].docking_status == ShipDockingStatus::Docked;
+                    }
+
+                    const int produced = std::min(planet.remaining_production, docked * constants::BASE_PRODUCTIVITY);
+                    planet.current_production += produced;
+                    planet.remaining_production -= produced;
+
+                    while (planet.current_production >= constants::PRODUCTION_PER_SHIP) {
+                        planet.current_production -= constants::PRODUCTION_PER_SHIP;
+                        spawn_ship(planet);
+                    }
+                }
+            }
+
+        public:
+            int map_width = 0;
+            int map_height = 0;
+            int turn = 0;
+
+            SimShip ships[MAX_SHIPS];
+            int ship_count = 0;
+
+            SimPlanet planets[MAX_PLANETS];
+            int planet_count = 0;
+
+            EntityId next_ship_id = 0;
+
+            /**
+             * Copy another state's entities without dragging along its event
+             * and scratch buffers, which is most of the object.
+             */
+            void copy_from(const GameState& other) {
+                map_width = other.map_width;
+                map_height = other.map_height;
+                turn = other.turn;
+                ship_count = other.ship_count;
+                planet_count = other.planet_count;
+                next_ship_id = other.next_ship_id;
+                std::copy(other.ships, other.ships + ship_count, ships);
+                std::copy(other.planets, other.planets + planet_count, planets);
+                begin_commands();
+            }
+
+            void load(const Map& map) {
+                map_width = map.map_width;
+                map_height = map.map_height;
+                ship_count = 0;
+                planet_count = 0;
+                next_ship_id = 0;
+
+                for (const Planet& planet : map.planets) {
+                    if (planet_count >= MAX_PLANETS) {
+                        break;
+                    }
+                    SimPlanet& sim = planets[planet_count++];
+                    sim = { planet.entity_id, planet.location.pos_x, planet.location.pos_y, planet.radius, planet.health,
+                            (int) planet.docking_spots, planet.current_production, planet.remaining_production,
+                            planet.is_owned ? planet.owner_id : -1, true, 0, {} };
+                }
+
+                for (const auto& player_ship : map.ships) {
+                    for (const Ship& ship : player_ship.second) {
+                        if (ship_count >= MAX_SHIPS) {
+                            break;
+                        }
+
+                        int planet = -1;
+                        if (ship.docking_status != ShipDockingStatus::Undocked) {
+                            planet = planet_index(ship.docked_planet);
+                        }
+
+                        ships[ship_count] = { ship.entity_id, player_ship.first, ship.location.pos_x, ship.location.pos_y,
+                                              0, 0, ship.health, ship.weapon_cooldown, ship.docking_status,
+                                              ship.docking_progress, planet, true };
+                        if (planet >= 0 && planets[planet].docked_count < MAX_DOCKED) {
+                            planets[planet].docked[planets[planet].docked_count++] = ship_count;
+                        }
+                        next_ship_id = std::max(next_ship_id, ship.entity_id + 1);
+                        ship_count++;
+                    }
+                }
+
+                begin_commands();
+            }
+
+            int planet_index(const EntityId planet_id) const {
+                for (int p = 0; p < planet_count; ++p) {
+                    if (planets[p].entity_id == planet_id) {
+                        return p;
+                    }
+                }
+                return -1;
+            }
+
+            int ship_index(const PlayerId owner_id, const EntityId ship_id) const {
+                for (int i = 0; i < ship_count; ++i) {
+                    if (ships[i].alive && ships[i].owner_id == owner_id && ships[i].entity_id == ship_id) {
+                        return i;
+                    }
+                }
+                return -1;
+            }
+
+            /// Queue one player's command for the next step(). Invalid commands are ignored, like the engine does.
+            void apply_move(const PlayerId player_id, const Move& move) {
+                const int index = ship_index(player_id, move.ship_id);
+                if (index < 0) {
+                    return;
+                }
+                SimShip& ship = ships[index];
+
+                switch (move.type) {
+                    case MoveType::Noop:
+                        break;
+                    case MoveType::Thrust: {
+                        if (ship.docking_status != ShipDockingStatus::Undocked) {
+                            break;
+                        }
+                        const int thrust = std::max(0, std::min(constants::MAX_SPEED, move.move_thrust));
+                        const Location velocity = actions::displaced({ 0, 0 }, thrust, move.move_angle_deg);
+                        ship.vel_x = velocity.pos_x;
+                        ship.vel_y = velocity.pos_y;
+                        break;
+                    }
+                    case MoveType::Dock: {
+                        const int p = planet_index(move.dock_to);
+                        if (p < 0 || ship.docking_status != ShipDockingStatus::Undocked) {
+                            break;
+                        }
+                        const SimPlanet& planet = planets[p];
+                        const double distance = std::hypot(ship.pos_x - planet.pos_x, ship.pos_y - planet.pos_y);
+                        if (!planet.alive || distance > planet.radius + constants::DOCK_RADIUS + constants::SHIP_RADIUS) {
+                            break;
+                        }
+                        if (planet.owner_id >= 0 && planet.owner_id != player_id) {
+                            break;
+                        }
+                        if (planet.owner_id < 0 && dock_claimant[p] >= 0 && dock_claimant[p] != player_id) {
+                            // two players going for a free planet on the same turn both miss out
+                            dock_contested[p] = true;
+                        }
+                        dock_claimant[p] = planet.owner_id < 0 && dock_claimant[p] < 0 ? player_id : dock_claimant[p];
+                        dock_requested[index] = true;
+                        ship.docking_status = ShipDockingStatus::Docking;
+                        ship.docking_progress = constants::DOCK_TURNS;
+                        ship.planet = p;
+                        ship.vel_x = 0;
+                        ship.vel_y = 0;
+                        break;
+                    }
+                    case MoveType::Undock:
+                        if (ship.docking_status == ShipDockingStatus::Docked) {
+                            ship.docking_status = ShipDockingStatus::Undocking;
+                            ship.docking_progress = constants::DOCK_TURNS;
+                        }
+                        break;
+                }
+            }
+
+            /// Reset per-turn command bookkeeping; call before the apply_move() calls of a turn.
+            void begin_commands() {
+                std::fill(dock_requested, dock_requested + ship_count, false);
+                for (int p = 0; p < planet_count; ++p) {
+                    dock_contested[p] = false;
+                    dock_claimant[p] = -1;
+                }
+            }
+
+            /// Advance the whole game by one turn.
+            void step() {
+                // settle this turn's dock commands against planet capacity and contests
+                for (int i = 0; i < ship_count; ++i) {
+                    SimShip& ship = ships[i];
+                    if (!ship.alive || !dock_requested[i]) {
+                        continue;
+                    }
+                    dock_requested[i] = false;
+
+                    SimPlanet& planet = planets[ship.planet];
+                    if (dock_contested[ship.planet] || planet.docked_count >= std::min(planet.docking_spots, MAX_DOCKED)) {
+                        ship.docking_status = ShipDockingStatus::Undocked;
+                        ship.docking_progress = 0;
+                        ship.planet = -1;
+                        continue;
+                    }
+
+                    planet.docked[planet.docked_count++] = i;
+                    planet.owner_id = ship.owner_id;
+                }
+
+                for (int i = 0; i < ship_count; ++i) {
+                    if (ships[i].alive && ships[i].weapon_cooldown > 0) {
+                        ships[i].weapon_cooldown--;
+                    }
+                }
+
+                find_events();
+                process_events();
+                process_movement();
+                process_docking();
+                process_production();
+
+                turn++;
+            }
+
+            /**
+             * Work out the commands every ship must have been given to get from
+             * this state to next_map, from how far and which way it moved and
+             * how its docking status changed. Used to replay recorded frames.
+             */
+            void infer_moves(const Map& next_map) {
+                begin_commands();
+
+                for (int i = 0; i < ship_count; ++i) {
+                    const SimShip& ship = ships[i];
+                    if (!ship.alive) {
+                        continue;
+                    }
+
+                    const auto owned = next_map.ship_map.find(ship.owner_id);
+                    if (owned == next_map.ship_map.end()) {
+                        continue;
+                    }
+                    const auto found = owned->second.find(ship.entity_id);
+                    if (found == owned->second.end()) {
+                        continue;
+                    }
+                    const Ship& next = next_map.ships.at(ship.owner_id).at(found->second);
+
+                    if (ship.docking_status == ShipDockingStatus::Undocked) {
+                        if (next.docking_status == ShipDockingStatus::Docking) {
+                            apply_move(ship.owner_id, Move::dock(ship.entity_id, next.docked_planet));
+                            continue;
+                        }
+
+                        const double dx = next.location.pos_x - ship.pos_x;
+                        const double dy = next.location.pos_y - ship.pos_y;
+                        const int thrust = (int) std::lround(std::hypot(dx, dy));
+                        if (thrust > 0) {
+                            const int angle = util::angle_rad_to_deg_clipped(std::atan2(dy, dx));
+                            apply_move(ship.owner_id, Move::thrust(ship.entity_id, thrust, angle));
+                        }
+                    } else if (ship.docking_status == ShipDockingStatus::Docked &&
+                               next.docking_status == ShipDockingStatus::Undocking) {
+                        apply_move(ship.owner_id, Move::undock(ship.entity_id));
+                    }
+                }
+            }
+
+            /**
+             * Number of ships in next_map that this state gets wrong: missing,
+             * extra, or off in position, health or docking status.
+             */
+            int count_mismatches(const Map& next_map, int& compared) const {
+                int mismatches = 0;
+                compared = 0;
+
+                for (const auto& player_ship : next_map.ships) {
+                    for (const Ship& next : player_ship.second) {
+                        compared++;
+                        const int index = ship_index(player_ship.first, next.entity_id);
+                        if (index < 0) {
+                            mismatches++;
+                            continue;
+                        }
+
+                        const SimShip& ship = ships[index];
+                        if (std::fabs(ship.pos_x - next.location.pos_x) > constants::SIMULATOR_POSITION_TOLERANCE ||
+                            std::fabs(ship.pos_y - next.location.pos_y) > constants::SIMULATOR_POSITION_TOLERANCE ||
+                            ship.health != next.health || ship.docking_status != next.docking_status) {
+                            mismatches++;
+                        }
+                    }
+                }
+
+                for (int i = 0; i < ship_count; ++i) {
+                    if (!ships[i].alive) {
+                        continue;
+                    }
+                    const auto owned = next_map.ship_map.find(ships[i].owner_id);
+                    if (owned == next_map.ship_map.end() || owned->second.find(ships[i].entity_id) == owned->second.end()) {
+                        mismatches++;
+                    }
+                }
+
+                return mismatches;
+            }
+        };
+    }
+}
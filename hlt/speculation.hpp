@@ -0,0 +1,244 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "flow_field.hpp"
+#include "influence_map.hpp"
+#include "map.hpp"
+
+namespace hlt {
+    namespace speculation {
+        struct SpeculationReport {
+            bool had_prediction = false;
+            /// Ships whose predicted influence covered exactly the grid points their real one does.
+            unsigned int kept = 0;
+            unsigned int moved = 0;
+            unsigned int added = 0;
+            unsigned int removed = 0;
+            unsigned int fields_adopted = 0;
+            double background_ms = 0;
+        };
+
+        /**
+         * Works on the next turn while we sit waiting for its frame.
+         *
+         * After our moves are sent, we guess the next frame: our ships where
+         * their moves take them, enemies carrying on at their predicted
+         * velocity, and wake a background thread, kept for the whole game. Against that it builds the influence
+         * map, into its own buffer, so nothing is shared while it runs. Flow
+         * fields only depend on the planets, so it keeps a field to every
+         * planet and only builds them again when a planet has gone.
+         *
+         * When the frame arrives the influence map is swapped in and corrected
+         * ship by ship, moving only the ships whose real influence covers
+         * different grid points than the guess, which leaves it exactly as a
+         * fresh build would. The flow fields are copied in if the frame has
+         * the planets they were built for.
+         */
+        class Speculation {
+        private:
+            struct Stamp {
+                PlayerId owner_id;
+                Location location;
+            };
+
+            std::thread worker;
+            std::mutex mutex;
+            std::condition_variable wake;
+            /// Guarded by mutex: a guess waiting for the worker or being worked on, and game over.
+            bool is_busy = false;
+            bool stopping = false;
+
+            PlayerId player_id = -1;
+
+            // only touched by the worker while it runs
+            std::unique_ptr<Map> planets;
+            std::unordered_map<std::uint64_t, Stamp> stamps;
+            combat::InfluenceMap influence;
+            navigation::FlowFieldCache flow_fields;
+            bool rebuild_fields = true;
+            double background_ms = 0;
+
+            bool has_prediction = false;
+
+            static std::uint64_t key(const PlayerId owner_id, const EntityId ship_id) {
+                return (static_cast<std::uint64_t>(owner_id) << 32) | static_cast<std::uint32_t>(ship_id);
+            }
+
+            /// Wait for the worker to be done with the last guess.
+            void finish() {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return !is_busy; });
+            }
+
+            void work() {
+                for (;;) {
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        wake.wait(lock, [this] { return stopping || is_busy; });
+                        if (stopping) {
+                            return;
+                        }
+                    }
+
+                    run();
+
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        is_busy = false;
+                    }
+                    wake.notify_all();
+                }
+            }
+
+            static bool same_planets(const std::vector<Planet>& a, const std::vector<Planet>& b) {
+                if (a.size() != b.size()) {
+                    return false;
+                }
+                for (size_t i = 0; i < a.size(); ++i) {
+                    if (a[i].entity_id != b[i].entity_id || !(a[i].location == b[i].location) || a[i].radius != b[i].radius) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            void run() {
+                typedef std::chrono::steady_clock clock;
+                const clock::time_point start = clock::now();
+
+                influence.reset(planets->map_width, planets->map_height, player_id);
+                for (const auto& entry : stamps) {
+                    influence.add(entry.second.owner_id, entry.second.location, 1.0f);
+                }
+
+                if (rebuild_fields) {
+                    // once to mark every field stale, once more to drop those of planets that are gone
+                    flow_fields.begin_turn();
+                    flow_fields.begin_turn();
+                    for (const Planet& planet : planets->planets) {
+                        flow_fields.towards_planet(*planets, planet);
+                    }
+                }
+
+                background_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+            }
+
+        public:
+            ~Speculation() {
+                finish();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                wake.notify_all();
+                if (worker.joinable()) {
+                    worker.join();
+                }
+            }
+
+            /// Guess the next frame from this one, with our moves planned, and start working on it.
+            void begin(const Map& map, const PlayerId for_player) {
+                finish();
+                player_id = for_player;
+
+                if (!planets) {
+                    planets.reset(new Map(map.map_width, map.map_height));
+                }
+                rebuild_fields = !same_planets(planets->planets, map.planets);
+                if (rebuild_fields) {
+                    planets->planets = map.planets;
+                }
+
+                stamps.clear();
+                for (const auto& player_ships : map.ships) {
+                    for (const Ship& ship : player_ships.second) {
+                        if (ship.docking_status != ShipDockingStatus::Undocked) {
+                            continue;
+                        }
+                        // our ships go where they were sent and then sit still until planned;
+                        // enemies keep going, and will carry one more turn of velocity
+                        Location location = combat::InfluenceMap::stamp_point(ship);
+                        if (player_ships.first != player_id) {
+                            location.pos_x += ship.velocity.vel_x;
+                            location.pos_y += ship.velocity.vel_y;
+                        }
+                        stamps[key(player_ships.first, ship.entity_id)] = { player_ships.first, location };
+                    }
+                }
+
+                has_prediction = true;
+                if (!worker.joinable()) {
+                    worker = std::thread([this] { work(); });
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    is_busy = true;
+                }
+                wake.notify_all();
+            }
+
+            /**
+             * Swap the background's work in for this frame. Flow fields are only
+             * handed over once the cache has begun the turn. Returns whether
+             * the shared influence map is now up to date; if not, build it.
+             */
+            bool adopt(const Map& map, SpeculationReport& report) {
+                finish();
+                report = SpeculationReport();
+                if (!has_prediction) {
+                    return false;
+                }
+                has_prediction = false;
+                report.had_prediction = true;
+                report.background_ms = background_ms;
+
+                if (same_planets(planets->planets, map.planets)) {
+                    report.fields_adopted = navigation::FlowFieldCache::get().adopt(flow_fields);
+                }
+
+                std::unordered_map<std::uint64_t, char> seen;
+                for (const auto& player_ships : map.ships) {
+                    for (const Ship& ship : player_ships.second) {
+                        if (ship.docking_status != ShipDockingStatus::Undocked) {
+                            continue;
+                        }
+                        const Location real = combat::InfluenceMap::stamp_point(ship);
+                        const std::uint64_t ship_key = key(player_ships.first, ship.entity_id);
+                        const auto guess = stamps.find(ship_key);
+                        if (guess == stamps.end()) {
+                            influence.add(player_ships.first, real, 1.0f);
+                            report.added++;
+                            continue;
+                        }
+
+                        seen[ship_key] = 1;
+                        if (influence.same_footprint(guess->second.location, real)) {
+                            report.kept++;
+                        } else {
+                            influence.relocate(player_ships.first, guess->second.location, real);
+                            report.moved++;
+                        }
+                    }
+                }
+
+                for (const auto& entry : stamps) {
+                    if (seen.count(entry.first) == 0) {
+                        influence.add(entry.second.owner_id, entry.second.location, -1.0f);
+                        report.removed++;
+                    }
+                }
+
+                std::swap(combat::InfluenceMap::get(), influence);
+                return true;
+            }
+        };
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdlib>
+#include <unordered_map>
+
+#include "map.hpp"
+
+namespace hlt {
+    namespace strategy {
+        enum class ReplanReason {
+            None = 0,
+            FirstTurn,
+            Cadence,
+            OwnershipChange,
+            ShipSwing,
+        };
+
+        static const char* to_string(const ReplanReason reason) {
+            switch (reason) {
+                case ReplanReason::None:
+                    return "none";
+                case ReplanReason::FirstTurn:
+                    return "first turn";
+                case ReplanReason::Cadence:
+                    return "cadence";
+                case ReplanReason::OwnershipChange:
+                    return "planet changed hands";
+                case ReplanReason::ShipSwing:
+                    return "ship count swing";
+            }
+            return "unknown";
+        }
+
+        /**
+         * Decides when the fleet-level plan (whether to abandon, which targets
+         * every ship is assigned) is worth redoing.
+         *
+         * The plan is redone every STRATEGY_REPLAN_TURNS turns, or sooner when
+         * a planet changes hands or any player's fleet has grown or shrunk by
+         * more than STRATEGY_SHIP_SWING since the last plan. In between, ships
+         * keep working on the targets they were given.
+         */
+        class StrategicPlanner {
+        private:
+            int last_plan_turn = -1;
+            entity_map<PlayerId> planet_owners;
+            std::unordered_map<PlayerId, int> ship_counts;
+
+            static PlayerId owner_of(const Planet& planet) {
+                return planet.is_owned ? planet.owner_id : -1;
+            }
+
+            bool has_ownership_changed(const Map& map) const {
+                if (map.planets.size() != planet_owners.size()) {
+                    // a planet blew up
+                    return true;
+                }
+                for (const Planet& planet : map.planets) {
+                    const auto owner = planet_owners.find(planet.entity_id);
+                    if (owner == planet_owners.end() || owner->second != owner_of(planet)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool has_ship_count_swung(const Map& map) const {
+                for (const auto& player_ships : map.ships) {
+                    const auto planned = ship_counts.find(player_ships.first);
+                    const int before = planned == ship_counts.end() ? 0 : planned->second;
+                    const int now = player_ships.second.size();
+                    const double allowed = std::max(
+                        (double) constants::STRATEGY_SHIP_SWING_MIN, before * constants::STRATEGY_SHIP_SWING);
+                    if (std::abs(now - before) > allowed) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+        public:
+            int planned_turn() const {
+                return last_plan_turn;
+            }
+
+            ReplanReason should_replan(const Map& map, const int turn) const {
+                if (last_plan_turn < 0) {
+                    return ReplanReason::FirstTurn;
+                }
+                if (turn - last_plan_turn >= constants::STRATEGY_REPLAN_TURNS) {
+                    return ReplanReason::Cadence;
+                }
+                if (constants::STRATEGY_REPLAN_ON_OWNERSHIP_CHANGE && has_ownership_changed(map)) {
+                    return ReplanReason::OwnershipChange;
+                }
+                if (constants::STRATEGY_REPLAN_ON_SHIP_SWING && has_ship_count_swung(map)) {
+                    return ReplanReason::ShipSwing;
+                }
+                return ReplanReason::None;
+            }
+
+            /// Remember what the world looked like when the plan was made.
+            void mark_planned(const Map& map, const int turn) {
+                last_plan_turn = turn;
+
+                planet_owners.clear();
+                for (const Planet& planet : map.planets) {
+                    planet_owners[planet.entity_id] = owner_of(planet);
+                }
+
+                ship_counts.clear();
+                for (const auto& player_ships : map.ships) {
+                    ship_counts[player_ships.first] = player_ships.second.size();
+                }
+            }
+        };
+    }
+}
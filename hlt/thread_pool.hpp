@@ -0,0 +1,329 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "constants.hpp"
+
+namespace hlt {
+    /// Tasks started together and waited on together; see ThreadPool::run and ThreadPool::wait.
+    struct TaskGroup {
+        std::atomic<unsigned int> pending;
+
+        TaskGroup() : pending(0) {
+        }
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+    };
+
+    /// What the pool has been up to since the last reset_stats().
+    struct SchedulerStats {
+        unsigned long long tasks = 0;
+        /// Tasks taken from another thread's queue.
+        unsigned long long steals = 0;
+        /// Looks into another thread's queue that came back empty.
+        unsigned long long failed_steals = 0;
+        /// Time threads spent with nothing to run, summed over threads.
+        double idle_ms = 0;
+        /// Tasks run by the busiest and the quietest thread.
+        unsigned long long most_tasks = 0;
+        unsigned long long fewest_tasks = 0;
+    };
+
+    /**
+     * Worker threads that each keep their own queue of tasks and steal from
+     * one another when theirs runs dry.
+     *
+     * A task started from a worker goes on the back of that worker's queue
+     * and the worker takes its next task from the back too, so it keeps
+     * working on what it just split up. Idle workers steal from the front,
+     * where the biggest, oldest pieces are. Tasks started from any other
+     * thread go on a shared queue.
+     *
+     * The thread that waits on a group runs queued tasks until the group is
+     * done, so a task may start and wait on a group of its own without
+     * tying up its thread. That also means a task must not hold on to
+     * per-thread scratch across a wait, since another task may use it.
+     *
+     * size() counts the thread waiting as well as the workers, so a pool
+     * of one thread has no workers and runs everything in wait().
+     */
+    class ThreadPool {
+    private:
+        typedef std::chrono::steady_clock clock;
+
+        struct Task {
+            std::function<void()> run;
+            TaskGroup* group;
+        };
+
+        /// One per worker, and one more for whichever outside thread is waiting.
+        struct Lane {
+            std::deque<Task> tasks;
+            std::mutex mutex;
+
+            std::atomic<unsigned long long> tasks_run;
+            std::atomic<unsigned long long> steals;
+            std::atomic<unsigned long long> failed_steals;
+            std::atomic<unsigned long long> idle_us;
+            /// When the worker went to sleep, in now_us(); 0 while awake.
+            std::atomic<long long> sleeping_since;
+
+            Lane() : tasks_run(0), steals(0), failed_steals(0), idle_us(0), sleeping_since(0) {
+            }
+        };
+
+        std::vector<std::unique_ptr<Lane>> lanes;
+        std::vector<std::thread> workers;
+
+        /// Tasks sitting in any queue, so sleepers know whether to look.
+        std::atomic<int> queued;
+        std::atomic<int> sleepers;
+        std::atomic<bool> stopping;
+        std::mutex sleep_mutex;
+        std::condition_variable task_ready;
+        /// Idle time from before the last reset_stats() isn't counted.
+        std::atomic<long long> stats_reset_at;
+
+        static const ThreadPool*& current_pool() {
+            static thread_local const ThreadPool* pool = nullptr;
+            return pool;
+        }
+
+        static unsigned int& current_index() {
+            static thread_local unsigned int index = 0;
+            return index;
+        }
+
+        static long long now_us() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(clock::now().time_since_epoch()).count();
+        }
+
+        unsigned int outside_lane() const {
+            return lanes.size() - 1;
+        }
+
+        bool pop_back(Lane& lane, Task& task) {
+            std::lock_guard<std::mutex> lock(lane.mutex);
+            if (lane.tasks.empty()) {
+                return false;
+            }
+            task = std::move(lane.tasks.back());
+            lane.tasks.pop_back();
+            return true;
+        }
+
+        bool pop_front(Lane& lane, Task& task) {
+            std::lock_guard<std::mutex> lock(lane.mutex);
+            if (lane.tasks.empty()) {
+                return false;
+            }
+            task = std::move(lane.tasks.front());
+            lane.tasks.pop_front();
+            return true;
+        }
+
+        /// Own queue newest first, then the shared queue, then everyone else's oldest first.
+        bool find_task(const unsigned int index, Task& task) {
+            if (queued.load() <= 0) {
+                return false;
+            }
+
+            Lane& own = *lanes[index];
+            if (index != outside_lane() && pop_back(own, task)) {
+                queued--;
+                return true;
+            }
+            if (pop_front(*lanes[outside_lane()], task)) {
+                queued--;
+                return true;
+            }
+
+            for (unsigned int i = 1; i < lanes.size(); ++i) {
+                const unsigned int victim = (index + i) % lanes.size();
+                if (victim == outside_lane()) {
+                    continue;
+                }
+                if (pop_front(*lanes[victim], task)) {
+                    queued--;
+                    own.steals.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                own.failed_steals.fetch_add(1, std::memory_order_relaxed);
+            }
+            return false;
+        }
+
+        void execute(const unsigned int index, Task& task) {
+            task.run();
+            lanes[index]->tasks_run.fetch_add(1, std::memory_order_relaxed);
+            task.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        void work(const unsigned int index) {
+            current_pool() = this;
+            current_index() = index;
+
+            for (;;) {
+                Task task;
+                if (find_task(index, task)) {
+                    execute(index, task);
+                    continue;
+                }
+
+                Lane& lane = *lanes[index];
+                lane.sleeping_since = now_us();
+                {
+                    std::unique_lock<std::mutex> lock(sleep_mutex);
+                    sleepers++;
+                    task_ready.wait(lock, [this] { return stopping.load() || queued.load() > 0; });
+                    sleepers--;
+                }
+                add_idle(index, lane.sleeping_since.exchange(0));
+
+                if (stopping.load() && queued.load() <= 0) {
+                    return;
+                }
+            }
+        }
+
+        long long idle_since(const long long since_us) const {
+            return std::max(0LL, now_us() - std::max(since_us, stats_reset_at.load()));
+        }
+
+        void add_idle(const unsigned int index, const long long since_us) {
+            lanes[index]->idle_us.fetch_add(idle_since(since_us), std::memory_order_relaxed);
+        }
+
+    public:
+        /// thread_count counts the thread that will be waiting on tasks, so thread_count - 1 workers are started.
+        explicit ThreadPool(const unsigned int thread_count) : queued(0), sleepers(0), stopping(false), stats_reset_at(now_us()) {
+            const unsigned int worker_count = thread_count > 1 ? thread_count - 1 : 0;
+            for (unsigned int i = 0; i <= worker_count; ++i) {
+                lanes.emplace_back(new Lane());
+            }
+            for (unsigned int i = 0; i < worker_count; ++i) {
+                workers.emplace_back([this, i] { work(i); });
+            }
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+                stopping = true;
+            }
+            task_ready.notify_all();
+            for (std::thread& worker : workers) {
+                worker.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /// THREAD_POOL_SIZE if set, else one thread per core, or one if the core count is unknown.
+        static unsigned int default_thread_count() {
+            if (constants::THREAD_POOL_SIZE > 0) {
+                return constants::THREAD_POOL_SIZE;
+            }
+            const unsigned int cores = std::thread::hardware_concurrency();
+            return cores == 0 ? 1 : cores;
+        }
+
+        /// Threads running tasks: the workers and the one waiting.
+        unsigned int size() const {
+            return lanes.size();
+        }
+
+        /// Index in [0, size()) of the calling thread, for picking per-thread scratch.
+        unsigned int worker_index() const {
+            return current_pool() == this ? current_index() : outside_lane();
+        }
+
+        void run(TaskGroup& group, std::function<void()> task) {
+            group.pending.fetch_add(1, std::memory_order_relaxed);
+            Lane& lane = *lanes[worker_index()];
+            {
+                std::lock_guard<std::mutex> lock(lane.mutex);
+                lane.tasks.push_back({ std::move(task), &group });
+            }
+            queued++;
+
+            if (sleepers.load() > 0) {
+                {
+                    std::lock_guard<std::mutex> lock(sleep_mutex);
+                }
+                task_ready.notify_one();
+            }
+        }
+
+        /// Run queued tasks, the group's or anyone's, until every task in the group has finished.
+        void wait(TaskGroup& group) {
+            const unsigned int index = worker_index();
+            bool is_idle = false;
+            long long idle_start = 0;
+
+            while (group.pending.load(std::memory_order_acquire) > 0) {
+                Task task;
+                if (find_task(index, task)) {
+                    if (is_idle) {
+                        add_idle(index, idle_start);
+                        is_idle = false;
+                    }
+                    execute(index, task);
+                } else {
+                    if (!is_idle) {
+                        idle_start = now_us();
+                        is_idle = true;
+                    }
+                    // what's left is running on other threads
+                    std::this_thread::yield();
+                }
+            }
+
+            if (is_idle) {
+                add_idle(index, idle_start);
+            }
+        }
+
+        SchedulerStats stats() const {
+            SchedulerStats total;
+            unsigned long long idle_us = 0;
+            for (size_t i = 0; i < lanes.size(); ++i) {
+                const Lane& lane = *lanes[i];
+                const unsigned long long tasks_run = lane.tasks_run.load(std::memory_order_relaxed);
+                total.tasks += tasks_run;
+                total.steals += lane.steals.load(std::memory_order_relaxed);
+                total.failed_steals += lane.failed_steals.load(std::memory_order_relaxed);
+                idle_us += lane.idle_us.load(std::memory_order_relaxed);
+                const long long sleeping_since = lane.sleeping_since.load();
+                if (sleeping_since != 0) {
+                    idle_us += idle_since(sleeping_since);
+                }
+                total.most_tasks = i == 0 ? tasks_run : std::max(total.most_tasks, tasks_run);
+                total.fewest_tasks = i == 0 ? tasks_run : std::min(total.fewest_tasks, tasks_run);
+            }
+            total.idle_ms = idle_us / 1000.0;
+            return total;
+        }
+
+        void reset_stats() {
+            stats_reset_at = now_us();
+            for (const std::unique_ptr<Lane>& lane : lanes) {
+                lane->tasks_run = 0;
+                lane->steals = 0;
+                lane->failed_steals = 0;
+                lane->idle_us = 0;
+            }
+        }
+    };
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "map.hpp"
+#include "collision.hpp"
+
+namespace hlt {
+    namespace combat {
+        /// Who is coming for one of our docked ships, and who could get there to meet them.
+        struct Threat {
+            EntityId docked_ship_id;
+            Location location;
+
+            /// Turns until the nearest undocked enemy could be in weapon range; NO_CONTACT if there is none.
+            int contact_turns;
+            PlayerId attacker_owner;
+            EntityId attacker_id;
+
+            /// Our undocked ships that could reach weapon range soonest, soonest first.
+            int defender_count;
+            EntityId defenders[constants::THREAT_MAX_DEFENDERS];
+            int defender_turns[constants::THREAT_MAX_DEFENDERS];
+
+            bool has_attacker() const {
+                return contact_turns != NO_CONTACT;
+            }
+
+            static constexpr int NO_CONTACT = std::numeric_limits<int>::max();
+        };
+
+        /**
+         * Length of the shortest path from start to end that doesn't cut through
+         * planet, going along the tangents and around the rim if it's in the way.
+         */
+        static double path_around(const Location& start, const Location& end, const Planet& planet) {
+            const double straight = start.get_distance_to(end);
+            if (!collision::segment_circle_intersect(start, end, planet, 0)) {
+                return straight;
+            }
+
+            const double radius = planet.radius;
+            const double to_start = std::max(radius, start.get_distance_to(planet.location));
+            const double to_end = std::max(radius, end.get_distance_to(planet.location));
+            const double tangent_start = std::sqrt(to_start * to_start - radius * radius);
+            const double tangent_end = std::sqrt(to_end * to_end - radius * radius);
+
+            // angle at the planet between start and end, less what the tangents cover
+            const double ax = start.pos_x - planet.location.pos_x;
+            const double ay = start.pos_y - planet.location.pos_y;
+            const double bx = end.pos_x - planet.location.pos_x;
+            const double by = end.pos_y - planet.location.pos_y;
+            const double between = std::acos(std::max(-1.0, std::min(1.0, (ax * bx + ay * by) / (to_start * to_end))));
+            const double arc = std::max(0.0, between - std::acos(radius / to_start) - std::acos(radius / to_end));
+
+            return tangent_start + tangent_end + radius * arc;
+        }
+
+        /// Distance from start to end around whichever planet in the way costs the most.
+        static double path_length(const Map& map, const Location& start, const Location& end) {
+            double length = start.get_distance_to(end);
+            for (const Planet& planet : map.planets) {
+                length = std::max(length, path_around(start, end, planet));
+            }
+            return length;
+        }
+
+        static int turns_to_reach(const double distance, const double range) {
+            return (int) std::ceil(std::max(0.0, distance - range) / constants::MAX_SPEED);
+        }
+
+        /**
+         * For every one of our docked or docking ships, how soon an enemy could
+         * be shooting at it and which of our ships could be there first.
+         *
+         * Built once a turn over all docked ships together, so that ships
+         * deciding whether to defend look their answer up instead of each
+         * scanning their own sorted list of docked friends.
+         */
+        class ThreatTable {
+        private:
+            std::vector<Threat> threats;
+            entity_map<int> threat_of_docked;
+            /// For each defender, the most urgent threat it is listed against.
+            entity_map<int> threat_of_defender;
+            /// Soonest contact turns of every enemy that is first to one of our docked ships.
+            std::unordered_map<std::uint64_t, int> attacker_contact;
+
+            static std::uint64_t ship_key(const PlayerId owner_id, const EntityId ship_id) {
+                return (static_cast<std::uint64_t>(owner_id) << 32) | static_cast<std::uint32_t>(ship_id);
+            }
+
+            static double weapon_reach() {
+                return constants::WEAPON_RADIUS + 2 * constants::SHIP_RADIUS;
+            }
+
+        public:
+            static ThreatTable& get() {
+                static ThreatTable instance{};
+                return instance;
+            }
+
+            void build(const Map& map, const PlayerId player_id) {
+                threats.clear();
+                threat_of_docked.clear();
+                threat_of_defender.clear();
+                attacker_contact.clear();
+
+                const std::vector<Ship>& fleet = map.ships.at(player_id);
+                for (const Ship& docked : fleet) {
+                    if (docked.docking_status == ShipDockingStatus::Undocked) {
+                        continue;
+                    }
+
+                    Threat threat;
+                    threat.docked_ship_id = docked.entity_id;
+                    threat.location = docked.location;
+                    threat.contact_turns = Threat::NO_CONTACT;
+                    threat.attacker_owner = -1;
+                    threat.attacker_id = 0;
+                    threat.defender_count = 0;
+
+                    for (const auto& player_ships : map.ships) {
+                        if (player_ships.first == player_id) {
+                            continue;
+                        }
+                        for (const Ship& enemy : player_ships.second) {
+                            if (enemy.docking_status != ShipDockingStatus::Undocked) {
+                                continue;
+                            }
+                            // the straight line is never longer than the way round, so only go round if it could win
+                            const double straight = enemy.location.get_distance_to(docked.location);
+                            if (turns_to_reach(straight, weapon_reach()) >= threat.contact_turns) {
+                                continue;
+                            }
+                            const int turns = turns_to_reach(path_length(map, enemy.location, docked.location), weapon_reach());
+                            if (turns < threat.contact_turns) {
+                                threat.contact_turns = turns;
+                                threat.attacker_owner = player_ships.first;
+                                threat.attacker_id = enemy.entity_id;
+                            }
+                        }
+                    }
+
+                    for (const Ship& defender : fleet) {
+                        if (defender.docking_status != ShipDockingStatus::Undocked) {
+                            continue;
+                        }
+                        const double straight = defender.location.get_distance_to(docked.location);
+                        const int slowest = threat.defender_count == constants::THREAT_MAX_DEFENDERS ?
+                            threat.defender_turns[threat.defender_count - 1] : std::numeric_limits<int>::max();
+                        if (turns_to_reach(straight, weapon_reach()) >= slowest) {
+                            continue;
+                        }
+
+                        const int turns = turns_to_reach(path_length(map, defender.location, docked.location), weapon_reach());
+                        int slot = std::min(threat.defender_count, constants::THREAT_MAX_DEFENDERS - 1);
+                        if (threat.defender_count == constants::THREAT_MAX_DEFENDERS && turns >= threat.defender_turns[slot]) {
+                            continue;
+                        }
+                        threat.defender_count = std::min(threat.defender_count + 1, constants::THREAT_MAX_DEFENDERS);
+                        while (slot > 0 && threat.defender_turns[slot - 1] > turns) {
+                            threat.defenders[slot] = threat.defenders[slot - 1];
+                            threat.defender_turns[slot] = threat.defender_turns[slot - 1];
+                            slot--;
+                        }
+                        threat.defenders[slot] = defender.entity_id;
+                        threat.defender_turns[slot] = turns;
+                    }
+
+                    threat_of_docked[docked.entity_id] = threats.size();
+                    threats.push_back(threat);
+                }
+
+                for (size_t i = 0; i < threats.size(); ++i) {
+                    const Threat& threat = threats[i];
+                    if (!threat.has_attacker()) {
+                        continue;
+                    }
+
+                    const auto attacker = attacker_contact.find(ship_key(threat.attacker_owner, threat.attacker_id));
+                    if (attacker == attacker_contact.end() || attacker->second > threat.contact_turns) {
+                        attacker_contact[ship_key(threat.attacker_owner, threat.attacker_id)] = threat.contact_turns;
+                    }
+
+                    for (int d = 0; d < threat.defender_count; ++d) {
+                        const auto current = threat_of_defender.find(threat.defenders[d]);
+                        if (current == threat_of_defender.end() ||
+                            threats[current->second].contact_turns > threat.contact_turns) {
+                            threat_of_defender[threat.defenders[d]] = i;
+                        }
+                    }
+                }
+            }
+
+            const Threat* threat_to(const EntityId docked_ship_id) const {
+                const auto found = threat_of_docked.find(docked_ship_id);
+                return found == threat_of_docked.end() ? nullptr : &threats[found->second];
+            }
+
+            /// The most urgent threat ship is one of the first defenders for, if any.
+            const Threat* defended_by(const EntityId ship_id) const {
+                const auto found = threat_of_defender.find(ship_id);
+                return found == threat_of_defender.end() ? nullptr : &threats[found->second];
+            }
+
+            /// Whether the enemy ship is the first to reach one of our docked ships within turns.
+            bool is_attacker(const PlayerId owner_id, const EntityId ship_id, const int turns) const {
+                const auto found = attacker_contact.find(ship_key(owner_id, ship_id));
+                return found != attacker_contact.end() && found->second <= turns;
+            }
+
+            const std::vector<Threat>& all() const {
+                return threats;
+            }
+        };
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+#include "constants.hpp"
+
+namespace hlt {
+    namespace timing {
+        /**
+         * How much of this turn's time is left, counted from when the frame
+         * arrived.
+         *
+         * Planning asks it for effort(): full until TURN_DEGRADE_FRACTION of
+         * the usable time is gone, then falling to nothing at the deadline,
+         * which sits TURN_SAFETY_MARGIN_MS before the engine's limit. Searches
+         * scale their step counts by it, and ships still unplanned once it
+         * hits zero get a fallback move instead.
+         */
+        class TurnClock {
+        private:
+            typedef std::chrono::steady_clock clock;
+            clock::time_point started = clock::now();
+
+            static double usable_ms() {
+                return constants::TURN_TIME_LIMIT_MS - constants::TURN_SAFETY_MARGIN_MS;
+            }
+
+        public:
+            static TurnClock& get() {
+                static TurnClock instance{};
+                return instance;
+            }
+
+            /// Called as soon as a frame has been read, before it is parsed.
+            void start() {
+                started = clock::now();
+            }
+
+            double elapsed_ms() const {
+                return std::chrono::duration<double, std::milli>(clock::now() - started).count();
+            }
+
+            /// Time left before moves have to go out, safety margin already taken off.
+            double remaining_ms() const {
+                return usable_ms() - elapsed_ms();
+            }
+
+            bool is_out_of_time() const {
+                return remaining_ms() <= 0;
+            }
+
+            /// 1 for full effort, down to 0 at the deadline.
+            double effort() const {
+                const double degrade_from = usable_ms() * constants::TURN_DEGRADE_FRACTION;
+                const double elapsed = elapsed_ms();
+                if (elapsed <= degrade_from) {
+                    return 1;
+                }
+                return std::max(0.0, 1 - (elapsed - degrade_from) / (usable_ms() - degrade_from));
+            }
+
+            /// full scaled down by effort(), but never below minimum.
+            int scaled(const int full, const int minimum) const {
+                const double current = effort();
+                if (current >= 1) {
+                    return full;
+                }
+                return std::max(std::min(full, minimum), (int) (full * current));
+            }
+        };
+    }
+}